@@ -2,17 +2,18 @@
 #define AB_ADDER_HPP
 
 #include <utility>
-#ifdef _MSC_VER
- #include <functional>
-#elif defined __PATHCC__
- #include <boost/tr1/functional.hpp>
-#else
- #include <tr1/functional>
-#endif
+#include <vector>
+#include "CostBatch.hpp"
 
+/**
+ * The function the secant solver zeroes when moving flow from a max path
+ * segment onto a min one: cost of the min segment minus cost of the max
+ * segment, d units of flow later. Cost is the graph's cost function type.
+ */
+template<typename Cost>
 class ABAdder
 {
-	typedef const std::tr1::function<double(double)>* func;
+	typedef const Cost* func;
 	public:
 		ABAdder(unsigned long addNum, unsigned long subtractNum) {
 			add.reserve(addNum);
@@ -20,21 +21,61 @@ class ABAdder
 		}
 		double operator()(double d) const {
 			double ret = 0;
-			for(std::vector<std::pair<func, double> >::const_iterator i = add.begin(); i != add.end(); ++i)
-				ret += (*(i->first))(i->second + d);
-			for(std::vector<std::pair<func, double> >::const_iterator i = subtract.begin(); i != subtract.end(); ++i)
-				ret -= (*(i->first))(i->second - d);
+			const double* a = addedCosts(d);
+			for(std::size_t i = 0; i != add.size(); ++i)
+				ret += a[i];
+			const double* s = subtractedCosts(d);
+			for(std::size_t i = 0; i != subtract.size(); ++i)
+				ret -= s[i];
 			return ret;
 		}
+		/**
+		 * Value and slope together, for Newton's method.
+		 */
+		void operator()(double d, double& value, double& slope) const {
+			addCosts.resize(add.size());
+			addSlopes.resize(add.size());
+			subtractCosts.resize(subtract.size());
+			subtractSlopes.resize(subtract.size());
+			if(add.size()) add.evaluate(d, &addCosts[0], &addSlopes[0]);
+			value = slope = 0;
+			for(std::size_t i = 0; i != add.size(); ++i) {
+				value += addCosts[i];
+				slope += addSlopes[i];
+			}
+			if(subtract.size()) subtract.evaluate(-d, &subtractCosts[0], &subtractSlopes[0]);
+			for(std::size_t i = 0; i != subtract.size(); ++i) {
+				value -= subtractCosts[i];
+				slope += subtractSlopes[i];
+			}
+		}
+		bool linear() const { return add.linear() && subtract.linear(); }
+		/**
+		 * Each term's cost d units of flow later, in the order they were
+		 * added. Valid until the next evaluation.
+		 */
+		const double* addedCosts(double d) const {
+			addCosts.resize(add.size());
+			add.evaluate(d, addCosts.empty() ? 0 : &addCosts[0]);
+			return addCosts.empty() ? 0 : &addCosts[0];
+		}
+		const double* subtractedCosts(double d) const {
+			subtractCosts.resize(subtract.size());
+			subtract.evaluate(-d, subtractCosts.empty() ? 0 : &subtractCosts[0]);
+			return subtractCosts.empty() ? 0 : &subtractCosts[0];
+		}
 		void operator+=(std::pair<func, double> p) {
-			add.push_back(p);
+			add.push_back(p.first, p.second);
 		}
 		void operator-=(std::pair<func, double> p) {
-			subtract.push_back(p);
+			subtract.push_back(p.first, p.second);
 		}
 	private:
-		std::vector<std::pair<func, double> > add;
-		std::vector<std::pair<func, double> > subtract;
+		CostBatch<Cost> add;
+		CostBatch<Cost> subtract;
+		mutable std::vector<double> addCosts;
+		mutable std::vector<double> subtractCosts;
+		mutable std::vector<double> addSlopes, subtractSlopes;
 };
 
 #endif
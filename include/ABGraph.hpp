@@ -27,12 +27,23 @@ executable somewhat smaller. As a bonus, we can remove Boost as a dep soon.*/
 #define AB_GRAPH_HPP
 
 #include <vector>
+#include <algorithm>
+#include <utility>
 #include "GraphEdge.hpp"
-#include "BushNode.hpp"
-#include "HornerPolynomial.hpp"
 #include <iostream>
 #include "InputGraph.hpp"
 
+/**
+ * One origin's shortest-path tree, as ABGraph::dijkstra leaves it: nodes in
+ * the order they were settled, and each node's position in that order (-1
+ * if it wasn't reached). What a Bush starts from.
+ */
+struct ShortestPathTree
+{
+	std::vector<long> positions;
+	std::vector<unsigned> order;
+};
+
 /**
  * Graph class providing some nice, simple storage for bush-specific data.
  * Contains a simple Dijkstra's algorithm implementation.
@@ -40,17 +51,29 @@ executable somewhat smaller. As a bonus, we can remove Boost as a dep soon.*/
 
 class ABGraph
 {
+	public:
+		/**
+		 * How nodes are numbered internally. TNTP numbering scatters
+		 * neighbouring nodes (and their edges) all over memory; BFS and
+		 * reverse Cuthill-McKee orders put them close together. Ids
+		 * given to and printed by the graph are always the InputGraph's.
+		 */
+		enum NodeOrdering { INPUT_ORDER, BFS_ORDER, RCM_ORDER };
+
 	private:
 		std::vector<std::vector<unsigned> > forwardStructure;
 		std::vector<unsigned> edgeStructure;
 		std::vector<ForwardGraphEdge> forwardStorage;
 		std::vector<BackwardGraphEdge> backwardStorage;
+		std::vector<double> lengthStorage;//Same indices as the edges.
+		std::vector<unsigned> reversedLinks;//See inverse().
+		std::vector<unsigned> inArcStart;
+		std::vector<std::pair<unsigned, unsigned> > inArcStorage;//See inArcs().
+		std::vector<unsigned> internalIds;//InputGraph node id -> ours
+		std::vector<unsigned> inputIds;//Ours -> InputGraph node id
 		
-		std::vector<BushNode> nodeStorage;
 		//Better idea: Store these things in a row, as now, but ordered specially so we can store structure as 2 iterators.
-		unsigned numberOfEdges;
-		//NOTE: Is there any reason to store this member?
-		//Is it ever used?
+		unsigned numberOfEdges;//Real ones.
 
 		/**
 		 * Adds an edge. To-node and from-node are retrieved from the
@@ -59,55 +82,63 @@ class ABGraph
 				
 		class EdgeHolder {
 		public:
-			EdgeHolder(
-				unsigned to, unsigned from,
-				bool real=false,
-				InputGraph::VDF func=HornerPolynomial(
-					std::vector<double>(1, std::numeric_limits<double>::infinity())
-				)
-			) : first(to), second(from), real(real), func(func) {}
+			EdgeHolder(unsigned to, unsigned from, InputGraph::VDF func) :
+				first(to), second(from), func(func) {}
 			bool operator<(const EdgeHolder &e) const {
 				if(first != e.first) return first < e.first;
-				if(second != e.second) return second < e.second;
-				return real;
+				return second < e.second;
 			}
 			bool operator==(const EdgeHolder &e) const {
 				return (first==e.first && second==e.second);
 			}
 			unsigned first, second;
-			bool real;
 			InputGraph::VDF func;
 		};
 		
 		void addEdge(EdgeHolder &e) {
 			forwardStructure.at(e.second).push_back(static_cast<unsigned>(forwardStorage.size()));
-			backwardStorage.push_back(BackwardGraphEdge(e.func(0.0), &nodeStorage.at(e.second)));
-			forwardStorage.push_back(ForwardGraphEdge(e.func, &nodeStorage.at(e.first)));
+			backwardStorage.push_back(BackwardGraphEdge(e.second));
+			forwardStorage.push_back(ForwardGraphEdge(e.first));
+			lengthStorage.push_back(e.func(0.0));
 		}
 		
-		unsigned edge(long from, long to) {
-			//std::cout << "Looking for edge (" << from << ", " << to << ")" << std::endl;
-			
-			//std::cout << "indices: " << edgeStructure.at(to) << ", " << edgeStructure.at(to+1) << std::endl;
-			
-			for(unsigned i = edgeStructure.at(to); i != edgeStructure.at(to+1); ++i) {
-			//	std::cout << "\t have edge (" << (backwardStorage.at(i).fromNode()-&nodeStorage[0]) << ", " << to << ")" << std::endl;
-				if(backwardStorage.at(i).fromNode()-&nodeStorage[0] == from) {
-					return (i);
-				}
+		/**
+		 * Index of the edge (from, to), or numberOfEdges if there isn't one.
+		 */
+		unsigned edge(unsigned from, unsigned to) const {
+			for(unsigned i = edgeStructure[to]; i != edgeStructure[to+1]; ++i) {
+				if(backwardStorage[i].fromNode() == from) return i;
 			}
-			std::cerr << "Can't find edge (" << from << ", " << to << ")" << std::endl;
-			throw "Edge does not exist";
+			return numberOfEdges;
 		}//Not worth doing a binary search because traffic networks are so sparse
 		
 		void getEdgeList(std::vector<EdgeHolder>&, const InputGraph &);
+		void listInArcs();
+		class CostOrder;
+		void internCosts(const std::vector<EdgeHolder>&);
+		void orderNodes(const InputGraph &, NodeOrdering);
+
+	protected:
+		//Distinct cost functions, shared by every edge with the same one.
+		//CostGraph turns these into its own cost type and frees them.
+		std::vector<InputGraph::VDF> inputCosts;
+		std::vector<unsigned> costIndex;//Edge -> inputCosts entry.
+		void setLength(unsigned index, double length) { lengthStorage[index] = length; }
+		double flow(unsigned index) const { return forwardStorage[index].getFlow(); }
 
 	public:
 		/**
 		 * ABGraph constructor. Does some minor heavy lifting, setting
 		 * up storage and edge inverses from the InputGraph.
 		 */
-		ABGraph(const InputGraph& g);
+		ABGraph(const InputGraph& g, NodeOrdering ordering = INPUT_ORDER);
+		
+		/**
+		 * Maps InputGraph node ids to the graph's own numbering. Origins
+		 * have to go through this before they meet the graph.
+		 */
+		const std::vector<unsigned>& nodeNumbering() const { return internalIds; }
+		unsigned inputId(unsigned node) const { return inputIds[node]; }
 
 		/**
 		 * Simple structure query, returns index of edges between two nodes.
@@ -119,8 +150,69 @@ class ABGraph
 			return backwardStorage[index];
 		}
 		
-		std::vector<BackwardGraphEdge>::iterator edgesFrom(unsigned index) {
-			return backwardStorage.begin()+edgeStructure.at(index);
+		/**
+		 * Index of the first edge into node index. Edges into a node are
+		 * contiguous, so they run up to edgesFrom(index+1).
+		 */
+		unsigned edgesFrom(unsigned index) const {
+			return edgeStructure.at(index);
+		}
+		
+		/**
+		 * Bushes sometimes need a link turned around. Where the network
+		 * has a link the other way that's the inverse; where it doesn't,
+		 * the reversed link gets an index past the real edges with an
+		 * infinite length and nothing else stored for it, so Dijkstra and
+		 * the edge arrays only ever see real links. inverse() and
+		 * fromNode() take either kind of index.
+		 */
+		unsigned inverse(unsigned index) const {
+			return index < numberOfEdges ? forwardStorage[index].getInverse() : reversedLinks[index-numberOfEdges];
+		}
+		unsigned fromNode(unsigned index) const {
+			return index < numberOfEdges ? backwardStorage[index].fromNode() : forwardStorage[reversedLinks[index-numberOfEdges]].toNode();
+		}
+		bool isReversed(unsigned index) const { return index >= numberOfEdges; }
+		
+		/**
+		 * Everything a bush might use into node index, as (edge, from-node)
+		 * pairs in from-node order: the real in-edges and the reversed
+		 * one-way links out of it. Runs up to inArcs(index+1).
+		 */
+		const std::pair<unsigned, unsigned>* inArcs(unsigned index) const {
+			return &inArcStorage[0] + inArcStart[index];
+		}
+		
+		/**
+		 * Current length (cost) of an edge. CostGraph works lengths out
+		 * lazily, so these are as of its last refreshLengths().
+		 */
+		double length(unsigned index) const { return lengthStorage[index]; }
+		const double* lengths() const { return &lengthStorage[0]; }
+		
+		/**
+		 * Adds flow to an edge when the caller already knows its new
+		 * length. CostGraph can work the length out itself.
+		 */
+		void addFlow(unsigned index, double d, double length) {
+			forwardStorage[index].addFlow(d);
+			lengthStorage[index] = length;
+		}
+		
+		/**
+		 * Takes g's link flows and lengths. g has to be a copy of the
+		 * same network.
+		 */
+		void copyFlows(const ABGraph& g) {
+			forwardStorage = g.forwardStorage;
+			lengthStorage = g.lengthStorage;
+		}
+		/**
+		 * Same, for just the one edge.
+		 */
+		void copyFlow(const ABGraph& g, unsigned index) {
+			forwardStorage[index] = g.forwardStorage[index];
+			lengthStorage[index] = g.lengthStorage[index];
 		}
 		
 		/**
@@ -148,47 +240,53 @@ class ABGraph
 			return forwardStorage.end();
 		}
 		
-		BackwardGraphEdge* backward(const ForwardGraphEdge* f) {
-			return &backwardStorage[f-&forwardStorage[0]];
-		}
-		ForwardGraphEdge* forward(const BackwardGraphEdge* b) {
-			return &forwardStorage[b-&backwardStorage[0]];
+		/**
+		 * Free-flow shortest paths from origin. order gets the nodes in
+		 * the order they're settled (a topological order for the
+		 * shortest-path DAG) and distances each node's position in it,
+		 * or -1 if it can't be reached; distances has to come in all -1.
+		 * Given destinations, stops once they're all settled and puts
+		 * the rest of the reachable nodes after them breadth-first.
+		 */
+		void dijkstra(unsigned origin, std::vector<long>& distances, std::vector<unsigned>& order,
+			const std::vector<std::pair<int, double> >* destinations = 0);
+		void dijkstra(unsigned origin, ShortestPathTree& tree, const std::vector<std::pair<int, double> >* destinations = 0) {
+			tree.positions.assign(numVertices(), -1);
+			tree.order.clear();
+			tree.order.reserve(numVertices());
+			dijkstra(origin, tree.positions, tree.order, destinations);
 		}
 		
-		//TODO: Add param info, have it return a good topo order (visited).
-		void dijkstra(unsigned origin, std::vector<long>& distances, std::vector<unsigned>& order);
-		
 		/**
 		 * Returns the total user travel time in the current solution.
 		 */
 		double currentCost() const {
 			double cost = 0.0;
 			std::vector<ForwardGraphEdge>::const_iterator i = forwardStorage.begin();
-			std::vector<BackwardGraphEdge>::const_iterator j = backwardStorage.begin();
+			std::vector<double>::const_iterator j = lengthStorage.begin();
 			for(; i != forwardStorage.end(); ++i, ++j)
-				if(i->getFlow() != 0) cost += i->getFlow()*j->distance();
-				//0 flow could mean imaginary arc, in which case 0*infinity = NaN.
+				cost += i->getFlow()**j;
 			return cost;
 		}
 		
-		/**
-		 * Node storage access.
-		 */
-		//FIXME: Is this used? It seems kinda bad for it to be public, non-const.
-		std::vector<BushNode>& nodes() { return nodeStorage; }
-		
 		friend std::ostream& operator<<(std::ostream& o, ABGraph & g) {
-			o << "<NUMBER OF NODES> \t" << g.nodeStorage.size()<<std::endl;
+			o << "<NUMBER OF NODES> \t" << g.forwardStructure.size()<<std::endl;
 			o << "<NUMBER OF LINKS> \t" << g.backwardStorage.size()<<std::endl;
 			o << "<END OF METADATA>\t\t\n\n\n";
 			o << "~ \tTail \tHead \t: \tVolume \tCost \t; \n";
 			
-			for(unsigned i = 0; i < g.forwardStructure.size(); ++i) {
-				for(unsigned j=0; j < g.forwardStructure[i].size(); ++j) {
-					BackwardGraphEdge& bEdge = g.backwardStorage[g.forwardStructure[i][j]];
-					ForwardGraphEdge& fEdge = g.forwardStorage[g.forwardStructure[i][j]];
+			//In input order, whatever order we keep things in.
+			std::vector<std::pair<unsigned, unsigned> > out;
+			for(unsigned n = 0; n < g.inputIds.size(); ++n) {
+				std::vector<unsigned>& structure = g.forwardStructure[g.internalIds[n]];
+				out.clear();
+				for(unsigned j=0; j < structure.size(); ++j)
+					out.push_back(std::make_pair(g.inputIds[g.forwardStorage[structure[j]].toNode()], structure[j]));
+				std::sort(out.begin(), out.end());
+				for(unsigned j=0; j < out.size(); ++j) {
+					ForwardGraphEdge& fEdge = g.forwardStorage[out[j].second];
 					
-					o << "\t" <<i+1<<" \t"<<fEdge.toNode()-&g.nodeStorage.front()+1<<" \t: \t"<<fEdge.getFlow()<<" \t" << bEdge.distance() <<" \t; \n";
+					o << "\t" <<n+1<<" \t"<<out[j].first+1<<" \t: \t"<<fEdge.getFlow()<<" \t" << g.lengthStorage[out[j].second] <<" \t; \n";
 				}
 			}
 			o.flush();
@@ -196,4 +294,106 @@ class ABGraph
 		}
 };
 
+/**
+ * An ABGraph along with its links' cost functions, stored as Cost. Cost is
+ * CostFunction in general, or something leaner like IntegerBPR when every
+ * link allows it; the bushes and solver are templated to match.
+ */
+template<typename Cost>
+class CostGraph : public ABGraph
+{
+	public:
+		CostGraph(const InputGraph& g, NodeOrdering ordering = INPUT_ORDER) : ABGraph(g, ordering), tracked(0) {
+			//Sharing costs an index per edge, which is more than it saves
+			//if hardly any functions repeat and Cost is small. Then each
+			//edge gets its own copy, as before.
+			std::size_t edges = costIndex.size();
+			if(sizeof(Cost)*inputCosts.size() + sizeof(unsigned)*edges < sizeof(Cost)*edges) {
+				costFunctions.reserve(inputCosts.size());
+				for(std::size_t i = 0; i < inputCosts.size(); ++i)
+					costFunctions.push_back(Cost(inputCosts[i]));
+			} else {
+				costFunctions.reserve(edges);
+				for(std::size_t i = 0; i < edges; ++i)
+					costFunctions.push_back(Cost(inputCosts[costIndex[i]]));
+				std::vector<unsigned>().swap(costIndex);
+			}
+			std::vector<InputGraph::VDF>().swap(inputCosts);
+			dirty.resize(edges, false);
+			logged.resize(edges, false);
+		}
+		
+		const Cost* costFunction(unsigned index) const { return &costFunctions[slot(index)]; }
+		
+		/**
+		 * Adds flow to an edge. Its length isn't worked out until the
+		 * next refreshLengths(), so an edge that gets flow from lots of
+		 * destinations in a row (sending out initial flows, say) only
+		 * has its cost evaluated once.
+		 */
+		using ABGraph::addFlow;
+		void addFlow(unsigned index, double d) {
+			forwardEdge(index).addFlow(d);
+			if(!dirty[index]) {
+				dirty[index] = true;
+				dirtyEdges.push_back(index);
+			}
+			if(tracked && !logged[index]) log(index);
+		}
+		void addFlow(unsigned index, double d, double length) {
+			ABGraph::addFlow(index, d, length);
+			dirty[index] = false;
+			if(tracked && !logged[index]) log(index);
+		}
+		/**
+		 * From now on, until track(0), every edge given flow goes on the
+		 * end of changed, once.
+		 */
+		void track(std::vector<unsigned>* changed) {
+			if(tracked) {
+				for(std::vector<unsigned>::const_iterator i = tracked->begin(); i != tracked->end(); ++i)
+					logged[*i] = false;
+			}
+			tracked = changed;
+		}
+		
+		/**
+		 * Brings the lengths of edges whose flow has changed up to date.
+		 * Needs doing before anything reads lengths.
+		 */
+		void refreshLengths() {
+			for(std::vector<unsigned>::const_iterator i = dirtyEdges.begin(); i != dirtyEdges.end(); ++i) {
+				if(dirty[*i]) {
+					setLength(*i, costFunctions[slot(*i)](flow(*i)));
+					dirty[*i] = false;
+				}
+			}
+			dirtyEdges.clear();
+		}
+		/**
+		 * See ABGraph::copyFlows. g's lengths have to be up to date.
+		 */
+		void copyFlows(const CostGraph& g) {
+			ABGraph::copyFlows(g);
+			for(std::vector<unsigned>::const_iterator i = dirtyEdges.begin(); i != dirtyEdges.end(); ++i)
+				dirty[*i] = false;
+			dirtyEdges.clear();
+		}
+		void copyFlow(const CostGraph& g, unsigned index) {
+			ABGraph::copyFlow(g, index);
+			dirty[index] = false;
+		}
+	private:
+		unsigned slot(unsigned index) const { return costIndex.empty() ? index : costIndex[index]; }
+		void log(unsigned index) {
+			logged[index] = true;
+			tracked->push_back(index);
+		}
+		std::vector<unsigned>* tracked;
+		std::vector<bool> logged;//Already on the end of *tracked.
+		std::vector<Cost> costFunctions;//Cold, so out of the edges.
+		std::vector<bool> dirty;//Flow changed since the length was worked out.
+		std::vector<unsigned> dirtyEdges;
+};
+
 #endif
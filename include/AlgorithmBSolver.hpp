@@ -30,27 +30,57 @@
 #include "Bush.hpp"
 #include "ABGraph.hpp"
 #include "InputGraph.hpp"
+#include "OriginQueue.hpp"
+#include "MThread.hpp"
 
 /**
  * Solver for the Traffic Assignment Problem using an algorithm like (but not
  * the same as) Robert Dial's Algorithm B. Probably needs renaming? Either
  * way, it's really swell.
+ * Cost is the links' cost function type: CostFunction works for anything,
+ * IntegerBPR is quicker when every link fits it.
  */
+template<typename Cost>
 class AlgorithmBSolver
 {
 	
 	public:
 		/**
-		 * TODO
+		 * Builds a bush for every origin in g. stopAtDestinations lets
+		 * each bush's initial Dijkstra stop once the origin's
+		 * destinations are settled; quicker on big networks where trips
+		 * are local, at the cost of poorer starting bushes.
+		 * Bushes are built batchSize origins at a time, split between up
+		 * to threads threads. A batch's bushes are all built against the
+		 * same link lengths, and their initial flows go onto the links
+		 * afterwards, in origin order, so the result doesn't depend on the
+		 * number of threads. With 1 each bush sees the flows of all the
+		 * ones before it.
 		 */
-		AlgorithmBSolver(const InputGraph& g);
+		AlgorithmBSolver(const InputGraph& g, ABGraph::NodeOrdering ordering = ABGraph::INPUT_ORDER, bool stopAtDestinations = false, unsigned batchSize = 1, unsigned threads = 1);
 		
 		/**
-		 * TODO
+		 * Pipelined construction: g only needs its links, origins arrive
+		 * on the queue while the trips file is still being parsed and get
+		 * their bushes built straight away. Returns once the queue closes.
 		 */
-		void solve(unsigned iterationLimit = std::numeric_limits<unsigned>::max());
+		AlgorithmBSolver(const InputGraph& g, OriginQueue& origins, ABGraph::NodeOrdering ordering = ABGraph::INPUT_ORDER, bool stopAtDestinations = false, unsigned batchSize = 1, unsigned threads = 1);
+		
+		/**
+		 * Runs up to iterationLimit sweeps over the bushes, returning how
+		 * many it did (fewer if there was nothing left to fix).
+		 * With roundSize > 1 the bushes are fixed in Jacobi-style rounds
+		 * of that many, shared out between the threads. Each moves its
+		 * flows around on its own copy of the links as they were at the
+		 * start of the round, and then their changes go onto the real
+		 * links in turn, so long as they still help; see fixRound(). That
+		 * takes a few more iterations than going one bush at a time, but
+		 * the result only depends on roundSize, not on the threads. Best
+		 * with at least as many bushes in a round as there are threads.
+		 */
+		unsigned solve(unsigned iterationLimit = std::numeric_limits<unsigned>::max(), unsigned roundSize = 1);
 
-		bool fixBushSets(std::list<Bush*>& fix, std::list<Bush*>& output, double average, bool whetherMove);
+		bool fixBushSets(std::list<Bush<Cost>*>& fix, std::list<Bush<Cost>*>& output, double average, bool whetherMove, unsigned roundSize = 1);
 		
 //		/**
 //		 * TODO
@@ -58,17 +88,18 @@ class AlgorithmBSolver
 //		void outputAnswer(boost::shared_ptr<InputGraph>) const;
 
 		void printBushes() {
-			for(std::list<Bush*>::const_iterator i = bushes.begin(); i != bushes.end(); ++i) {
+			for(typename std::list<Bush<Cost>*>::const_iterator i = bushes.begin(); i != bushes.end(); ++i) {
 				std::cout << "-  - - - -- -  - - - - - - - - - -- " << std::endl;
 				(*i)->printCrap();
 			}
-			for(std::list<Bush*>::const_iterator i = lazyBushes.begin(); i != lazyBushes.end(); ++i) {
+			for(typename std::list<Bush<Cost>*>::const_iterator i = lazyBushes.begin(); i != lazyBushes.end(); ++i) {
 				std::cout << "-  - - - -- -  - - - - - - - - - -- " << std::endl;
 				(*i)->printCrap();
 			}
 		}
 
 		friend std::ostream& operator<<(std::ostream& o, AlgorithmBSolver & abs) {
+			abs.graph.refreshLengths();
 			o << abs.graph;
 			return o;
 		}
@@ -79,18 +110,72 @@ class AlgorithmBSolver
 		~AlgorithmBSolver();
 		//NOTE: Have we remembered to clean up nonexistant edges?
 	private:
+		//Builds the bushes for a run of a batch's origins, on one thread.
+		struct BushBuilder {
+			void operator()();
+			CostGraph<Cost>* graph;
+			std::list<Origin>::iterator first, end;
+			ShortestPathTree* trees;
+			Bush<Cost>** built;
+			BushScratch* scratch;
+			bool stopAtDestinations, loadGraph;
+		};
+		void buildBushes(std::list<Origin>::iterator, std::list<Origin>::iterator, std::vector<ShortestPathTree>&, bool);
+		
+		//A run of a round's bushes, for one thread. First each bush's
+		//flows are equilibriated on the thread's copy of the links, which
+		//goes back to how it was afterwards. Once the round's changes are
+		//on the real links the copy gets them too, and the bushes turn
+		//around any edges that need it.
+		struct BushFixer {
+			void operator()();
+			CostGraph<Cost>* graph;//Read only while threads are running.
+			CostGraph<Cost>* copy;
+			BushScratch* scratch;
+			BushScratch* home;//What the bushes go back to afterwards.
+			Bush<Cost>** first;
+			Bush<Cost>** end;
+			char* fixed;
+			double average;
+			bool equilibriating;
+			std::vector<std::vector<double> > before;//Each bush's flows going in.
+			std::vector<unsigned> changed;//Links a bush changed on the copy.
+			const std::vector<unsigned>* moved;//Links the round's commits changed.
+		};
+		void fixRound(std::vector<Bush<Cost>*>&, std::vector<char>&, double);
+		
+		//Works something out for a run of the bushes, on one thread.
+		struct BushMeasurer {
+			void operator()();
+			CostGraph<Cost>* graph;
+			BushScratch* scratch;
+			BushScratch* home;
+			Bush<Cost>** first;
+			Bush<Cost>** end;
+			double (Bush<Cost>::*measure)();
+			double* values;
+		};
+		double sumOverBushes(double (Bush<Cost>::*)());
+		
 		//Edge data:
-		ABGraph graph;
+		CostGraph<Cost> graph;
 		
 		//Solver origin-specific data:
-		std::list<Bush*> bushes;
-		std::list<Bush*> lazyBushes;
+		std::list<Bush<Cost>*> bushes;
+		std::list<Bush<Cost>*> lazyBushes;
 		std::list<Origin> ODData;
 		
 		//So we don't have to allocate in topological sorts? Really?
 		//A premature optimisation, but probably an optimisation.
 		//So long as we clean it up, I guess...
-		std::vector<unsigned> tempStore;
-		std::vector<unsigned> reverseTS;
+		//One per thread. Bushes are pointed at the first one whenever
+		//they're not being worked on.
+		std::vector<BushScratch> scratch;
+		//Of the links, per thread, for fixing rounds. Kept the same as
+		//graph from one round to the next.
+		std::vector<CostGraph<Cost> > copies;
+		std::vector<BushFixer> fixers;
+		std::vector<unsigned> moved;//Links a round's commits changed.
+		MWorkers workers;//One thread per scratch, counting ours.
 };
 #endif
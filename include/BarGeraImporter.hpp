@@ -22,7 +22,14 @@
 #define BAR_GERA_IMPORTER_HPP
 
 #include "InputGraph.hpp"
+#include "NetworkCache.hpp"
+#include "MThread.hpp"
+#include "OriginQueue.hpp"
 #include <istream>
+#include <cstddef>
+#include <vector>
+
+class TNTPScanner;
 
 /**
  * A class to facilitate the importation of network files.
@@ -34,23 +41,128 @@ class BarGeraImporter {
 
 	public:
 		BarGeraImporter(double distanceCost, double tollCost) :
-			distanceCost(distanceCost), tollCost(tollCost) {}
+			distanceCost(distanceCost), tollCost(tollCost), powError(0), bytes(0), linkRecord(0),
+			threads(MThread::hardwareThreads()) {}
 		
 		void readInGraph(InputGraph& graph, std::istream& networkFile, std::istream& tripsFile);
+		
+		/**
+		 * Maps both files into memory and parses them in place. Faster
+		 * than the istream version, which now just copies its input into
+		 * a buffer and does the same thing.
+		 * gzipped files (and zstd ones, if built with EF_HAVE_ZSTD) are
+		 * spotted by their magic number and decompressed on another thread
+		 * while we parse.
+		 */
+		void readInGraph(InputGraph& graph, const char* networkFile, const char* tripsFile);
+		
+		/**
+		 * As above, but loads from the binary cache instead if it is up to
+		 * date with the text files. Otherwise parses them and writes a new
+		 * cache for next time.
+		 */
+		void readInGraph(InputGraph& graph, const char* networkFile, const char* tripsFile, const char* cacheFile);
+		
+		/**
+		 * The pipelined version: read the network first, then start
+		 * readInTrips on another thread. Each origin is pushed to the queue
+		 * as soon as its block has been parsed and the queue is closed at
+		 * the end (or on error). Big files are still parsed in chunks on
+		 * several threads, but the origins arrive in file order.
+		 * readInNetwork must have been called first.
+		 */
+		void readInNetwork(InputGraph& graph, const char* networkFile);
+		void readInTrips(const char* tripsFile, OriginQueue& origins);
+		
+		/**
+		 * Total size of the files read so far, for throughput reporting.
+		 */
+		std::size_t bytesRead() const { return bytes; }
+		
+		/**
+		 * Big files are cut into chunks (at row and Origin boundaries) and
+		 * parsed on up to this many threads. Defaults to one per core.
+		 */
+		void setThreads(unsigned t) { threads = t ? t : 1; }
+		
+		/**
+		 * Links with fractional betas normally evaluate std::pow. Give a
+		 * maximum relative error here and they use FastPow instead,
+		 * wherever it can guarantee that. 0 (the default) means exact.
+		 */
+		void setPowError(double e) { powError = e; }
 	private:
+		//Chunks smaller than this aren't worth a thread.
+		static const std::size_t minimumChunk = 1 << 20;
+		
+		//Parses the link rows in [begin, end) into a thread-local buffer.
+		struct NetworkChunk {
+			struct Row {
+				unsigned from, to;
+				double capacity, length, zeroFlowTime, alpha, beta, toll;
+			};
+			NetworkChunk(const char* begin, const char* end, unsigned nodes, unsigned zones) :
+				begin(begin), end(end), nodes(nodes), zones(zones) {}
+			void operator()();
+			const char* begin;
+			const char* end;
+			unsigned nodes, zones;
+			std::vector<Row> rows;
+		};
+		//Parses whole Origin blocks in [begin, end) into a thread-local
+		//buffer, or into Origins on stream if that isn't null. Rows before
+		//the first Origin keyword belong to currentNode, so one chunk can
+		//carry on where the last left off (say, across decompressed blocks).
+		struct TripsChunk {
+			TripsChunk(const char* begin, const char* end, unsigned nodes, unsigned zones, OriginQueue* stream, int currentNode = -1) :
+				begin(begin), end(end), nodes(nodes), zones(zones), stream(stream), currentNode(currentNode) {}
+			void operator()();
+			//Sends off the last origin, if streaming.
+			void finish() { if(stream) sendOrigin(); }
+			void sendOrigin();
+			const char* begin;
+			const char* end;
+			unsigned nodes, zones;
+			OriginQueue* stream;
+			int currentNode;
+			std::vector<InputGraph::Demand> demand;
+		};
+		
+		void splitChunks(const char* begin, const char* end, std::vector<const char*>& cuts, char boundary) const;
+		
+		template<typename Chunk>
+		void runChunks(std::vector<Chunk>& chunks) const;
+		
+		//Both of these handle compressed buffers too.
+		void readInNetwork(InputGraph& graph, const char* begin, const char* end);
+		
+		void readInTrips(InputGraph& graph, const char* begin, const char* end);
 		
-		void readInNetwork(InputGraph& graph, std::istream& networkFile);
+		//Parse link rows/destination rows in [begin, end) on as many threads
+		//as it's worth and add them to graph in file order.
+		void addLinks(InputGraph& graph, const char* begin, const char* end, unsigned& arcs);
 		
-		void readInTrips(InputGraph& graph, std::istream& tripsFile);
+		int addDemand(InputGraph& graph, const char* begin, const char* end, int currentNode);
 		
+		//Same, but for the pipelined reader: origins go onto the queue in
+		//file order. chunk streams to the queue and carries an unfinished
+		//origin over to the next call.
+		void streamDemand(TripsChunk& chunk, const char* begin, const char* end, OriginQueue& origins) const;
 		
-		void skipComments(std::istream&);
+		//Reads tags up to <END OF METADATA>, keeping the ones we care about.
+		//Returns false if we ran out of input first - call again with the
+		//next block to carry on.
+		bool readNetworkMetadata(TNTPScanner&, unsigned& arcs);
 		
-		void endMetadata(std::istream&);
+		bool readTripsMetadata(TNTPScanner&);
 		
 		double distanceCost;
 		double tollCost;
+		double powError;
 		unsigned nodes, zones;
+		std::size_t bytes;
+		std::vector<NetworkCache::Link>* linkRecord;//Non-null while building a cache.
+		unsigned threads;
 };
 
 
@@ -30,20 +30,74 @@
 #include <utility>
 #include <iostream>
 
+/**
+ * Working space for bushes: node labels and the topological sort's scratch
+ * arrays, all sized to the graph. Any number of bushes can share one, so
+ * long as only one of them is being worked on at a time.
+ */
+struct BushScratch
+{
+	explicit BushScratch(std::size_t nodes) : nodes(nodes), tempStore(nodes), reverseTS(nodes), positionMap(nodes) {}
+	BushNodes nodes;
+	std::vector<unsigned> tempStore;
+	std::vector<unsigned> reverseTS;
+	std::vector<unsigned> positionMap;
+};
+
+/**
+ * One origin's bush. Cost is the graph's cost function type.
+ */
+template<typename Cost>
 class Bush
 {
 	public:
-		Bush(const Origin&, ABGraph&, std::vector<unsigned>&, std::vector<unsigned>&);//Inits bush, sends initial flows
+		/**
+		 * Inits bush from the origin's shortest-path tree (which it takes
+		 * the order out of), sends initial flows. Works from the graph's
+		 * lengths as they are, without refreshing them.
+		 * If loadGraph is false the initial flows stay on the bush's own
+		 * edges and the graph is left alone, so bushes can be built on
+		 * several threads at once; loadInitialFlows() hands them over.
+		 */
+		Bush(const Origin&, CostGraph<Cost>&, BushScratch&, ShortestPathTree&, bool loadGraph = true);
+		void loadInitialFlows();
+		/**
+		 * Points the bush at another copy of the graph (the same network,
+		 * flows and all) and other scratch space, so a thread with its own
+		 * of each can work on it.
+		 */
+		void setWorkspace(CostGraph<Cost>& g, BushScratch& s) {
+			graph = &g;
+			scratch = &s;
+		}
 		bool fix(double);
+		/**
+		 * fix() in pieces, for solvers that want to do something in
+		 * between: moving flow between paths leaves the bush's edges
+		 * alone, and fixEdges() turns around any that need it against
+		 * the graph's lengths as they are, saying whether it did.
+		 * Between saveFlows() and the next fixEdges() the bush can say
+		 * how its links' flows have changed, or go back to how it was;
+		 * the graph isn't told either way.
+		 */
+		bool equilibriate(double accuracy) { return equilibriateFlows(accuracy); }
+		bool fixEdges();
+		void saveFlows(std::vector<double>&) const;
+		void flowChanges(const std::vector<double>&, std::vector<std::pair<unsigned, double> >&) const;
+		void restoreFlows(const std::vector<double>&);
 		void printCrap();
 		int getOrigin() { return origin.getOrigin(); }
+		/**
+		 * Both go by the graph's lengths as they are; refreshing them is
+		 * up to the caller, so several threads can ask at once.
+		 */
 		double allOrNothingCost();
 		double maxDifference();
 		~Bush();
 		void clearChanges() {
 			additions.clear();
 			deletions.clear();
-			tempStore.clear();
+			scratch->tempStore.clear();
 		}
 		bool anyChanges() {
 			return (additions.size()+deletions.size())>0;
@@ -52,29 +106,34 @@ class Bush
 		bool updateEdges();
 		void updateEdgeStorage(unsigned, unsigned, long);
 		bool equilibriateFlows(double);//Equilibriates, tells graph what's going on
-		void updateEdges(std::vector<BushEdge>::iterator&, std::vector<BushEdge>::iterator, double, unsigned);
+		void updateEdges(std::vector<BushEdge>::iterator&, std::vector<BushEdge>::iterator, double, unsigned, unsigned);
 		void buildTrees();
-		void sendInitialFlows();
+		void sendInitialFlows(bool);
 		//Makes sure all our edges are pointing in the right direction, and we're sorted well.
-		void setUpGraph();
+		void setUpGraph(const std::vector<long>&);
 		void topologicalSort();
 		void applyBushEdgeChanges();
 		void partialTS(unsigned, unsigned, long);
+		void remapPositions(unsigned, unsigned);
+		unsigned fromId(const BushEdge& e) const { return graph->fromNode(e.underlyingEdge()); }
 		
 		const Origin& origin;
 		std::vector<unsigned> edges;//Stores offsets into edge storage in TO.
 		std::vector<BushEdge> edgeStorage;//Stores BushEdges in contiguous memory (in TO)
+		//NOTE: BushEdges name their from-node by its position in topologicalOrdering,
+		//not by node id, and the scratch labels are indexed the same way. buildTrees then
+		//reads labels a short way back from the node it's working on instead of
+		//all over the place. reverseTS maps ids to positions.
 		
 		std::vector<unsigned> topologicalOrdering;
 		
-		//Shared with other bushes so we don't deallocate/reallocate data uselessly between bush iterations
-		std::vector<BushNode>& sharedNodes;
-		std::vector<unsigned>& tempStore;//Used in topo sort, don't want to waste the alloc/dealloc time.
-		std::vector<unsigned> &reverseTS;
+		//Shared with other bushes so we don't deallocate/reallocate data uselessly between bush iterations.
+		//Pointers rather than references so setWorkspace() can move us.
+		BushScratch* scratch;
 		
-		ABGraph& graph;
+		CostGraph<Cost>* graph;
 		
-		std::vector<std::pair<unsigned, BackwardGraphEdge*> > additions;//Used in updates. [to, edge]
+		std::vector<std::pair<unsigned, BushEdge> > additions;//Used in updates. [to, edge]
 			//could sort on to-node?
 		std::vector<std::pair<unsigned, BushEdge*> > deletions;//[to-node, edge]
 };
@@ -82,68 +141,71 @@ class Bush
 class NodeIndexComparator
 {
 public:
-	NodeIndexComparator(std::vector<BushNode> &sharedNodes) : sharedNodes(sharedNodes) {}
+	NodeIndexComparator(std::vector<unsigned> &reverseTS, BushNodes &sharedNodes) : reverseTS(reverseTS), sharedNodes(sharedNodes) {}
 	bool operator()(unsigned first, unsigned second) {
-		return sharedNodes[first].maxDist() < sharedNodes[second].maxDist();
+		return sharedNodes.maxDist(reverseTS[first]) < sharedNodes.maxDist(reverseTS[second]);
 	}
 private:
-	std::vector<BushNode> &sharedNodes;
+	std::vector<unsigned> &reverseTS;
+	BushNodes &sharedNodes;
 };
 class AdditionsComparator
 {
 public:
-	AdditionsComparator(std::vector<unsigned> &reverseTS, std::vector<BushNode> &sharedNodes) : reverseTS(reverseTS), sharedNodes(sharedNodes) {}
-	bool operator()(const std::pair<unsigned, BackwardGraphEdge*> &first, const std::pair<unsigned, BackwardGraphEdge*> &second) {
+	AdditionsComparator(std::vector<unsigned> &reverseTS, BushNodes &sharedNodes, ABGraph &graph) : reverseTS(reverseTS), sharedNodes(sharedNodes), graph(graph) {}
+	bool operator()(const std::pair<unsigned, BushEdge> &first, const std::pair<unsigned, BushEdge> &second) {
 		//1. Order by distance.
-		double firstDistance = sharedNodes[first.first].maxDist();
-		double secondDistance = sharedNodes[second.first].maxDist();
+		unsigned firstIndex = reverseTS[first.first];
+		unsigned secondIndex = reverseTS[second.first];
+		double firstDistance = sharedNodes.maxDist(firstIndex);
+		double secondDistance = sharedNodes.maxDist(secondIndex);
 		if (firstDistance != secondDistance) return firstDistance < secondDistance;
 		
 		//2. If distance is equal, order by existing reverseTS
-		unsigned firstIndex = reverseTS[first.first];
-		unsigned secondIndex = reverseTS[second.first];
 		if(firstIndex != secondIndex) return firstIndex < secondIndex;
 		
 		//3. If existing reverseTS is equal, order by from-node id
-		return first.second->fromNode() < second.second->fromNode();
+		return graph.fromNode(first.second.underlyingEdge()) < graph.fromNode(second.second.underlyingEdge());
 	}
 private:
 	std::vector<unsigned> &reverseTS;
-	std::vector<BushNode> &sharedNodes;
+	BushNodes &sharedNodes;
+	ABGraph &graph;
 };
 class DeletionsComparator
 {
 public:
-	DeletionsComparator(std::vector<unsigned> &reverseTS, std::vector<BushNode> &sharedNodes) : reverseTS(reverseTS), sharedNodes(sharedNodes) {}
+	DeletionsComparator(std::vector<unsigned> &reverseTS, BushNodes &sharedNodes) : reverseTS(reverseTS), sharedNodes(sharedNodes) {}
 	bool operator()(const std::pair<unsigned, BushEdge*> &first, const std::pair<unsigned, BushEdge*> &second) {
-		double firstDistance = sharedNodes[first.first].maxDist();
-		double secondDistance = sharedNodes[second.first].maxDist();
-		if(firstDistance != secondDistance) return firstDistance < secondDistance;//highest distance first
-		
 		unsigned firstIndex = reverseTS[first.first];
 		unsigned secondIndex = reverseTS[second.first];
+		double firstDistance = sharedNodes.maxDist(firstIndex);
+		double secondDistance = sharedNodes.maxDist(secondIndex);
+		if(firstDistance != secondDistance) return firstDistance < secondDistance;//highest distance first
+		
 		if(firstIndex != secondIndex) return firstIndex < secondIndex;//highest to-node TS index next (stable sort)
 		
 		return first.second < second.second;//edges in order.
 	}
 private:
 	std::vector<unsigned> &reverseTS;
-	std::vector<BushNode> &sharedNodes;
+	BushNodes &sharedNodes;
 };
 
 
 //Inlined because we call this once per node per iteration, and spend 35% of our time in here. FIXME
-inline void Bush::updateEdges(std::vector<BushEdge>::iterator &from, std::vector<BushEdge>::iterator end, double maxDist, unsigned id)
+template<typename Cost>
+inline void Bush<Cost>::updateEdges(std::vector<BushEdge>::iterator &from, std::vector<BushEdge>::iterator end, double maxDist, unsigned id, unsigned position)
 {
 	for(; from < end; ++from) {
-		if(from->fromNode()->maxDist() > maxDist) {
+		if(scratch->nodes.maxDist(from->fromNode()) > maxDist) {
 			deletions.push_back(std::make_pair(
 				id,
 				&*from
 			));
 			additions.push_back(std::make_pair(
-				from->fromNode()-&sharedNodes[0],
-				graph.forward(from->underlyingEdge())->getInverse()
+				topologicalOrdering[from->fromNode()],
+				BushEdge(graph->inverse(from->underlyingEdge()), position)
 			));
 		}
 	}
@@ -25,7 +25,6 @@
 #include <algorithm>
 #include <utility>
 
-#include "HornerPolynomial.hpp"
 #include "GraphEdge.hpp"
 
 #ifdef _MSC_VER
@@ -37,11 +36,12 @@
 #endif
 
 class ABGraph;
-class BushNode;
-class ForwardGraphEdge;
 /**
  * A bush-specific edge structure that only exists so we can know the
  * bush-specific flow on the edge. Lots of handy functions, though...
+ * Holds the ABGraph edge index and the from-node's position in the owning
+ * bush's topological order, so walking a bush's in-edges never has to touch
+ * the graph's edge structures.
  */
 class BushEdge
 {
@@ -49,19 +49,14 @@ class BushEdge
 		/**
 		 * TODO
 		 */
-		BushEdge(BackwardGraphEdge* arc) :
-			realEdge(arc), ownFlow(0) {}
+		BushEdge(unsigned edge, unsigned from) :
+			edge(edge), from(from), ownFlow(0) {}
 
 		/**
 		 * TODO
 		 */
 		BushEdge() :
-			realEdge(0), ownFlow(0) {}
-
-		/**
-		 * TODO
-		 */
-		double length() const { return realEdge->distance(); }
+			edge(0), from(0), ownFlow(0) {}
 
 		/**
 		 * TODO
@@ -75,30 +70,48 @@ class BushEdge
 		double flow() const { return ownFlow; }
 
 		/**
-		 * TODO
+		 * Position of the from-node in the bush's topological ordering.
 		 */
-		BushNode* fromNode() const { return realEdge->fromNode(); }
+		unsigned fromNode() const { return from; }
+		void setFromNode(unsigned position) { from = position; }
 
 		/**
-		 * Turns the arc around. We assume a topological sort will
+		 * Turns the arc around. position is where the old to-node sits
+		 * in the topological ordering. We assume a topological sort will
 		 * occur after this, and no other bush data is affected.
 		 * If the bush-specific flow is not zero the solution loses
 		 * feasibility.
 		 */
-		void swapDirection(ABGraph &g);
+		void swapDirection(ABGraph &g, unsigned position);
 
 		/**
-		 * TODO
+		 * Adds to our flow and the graph's, and updates the edge length.
+		 * Graph is a CostGraph, which knows the cost functions.
+		 */
+		template<typename Graph>
+		void addFlow(double d, Graph& g) {
+			ownFlow += d;
+			g.addFlow(edge, d);
+		}
+		/**
+		 * Just our flow. The graph has to be told some other way.
+		 */
+		void addFlow(double d) { ownFlow += d; }
+		void setFlow(double f) { ownFlow = f; }
+		/**
+		 * Same as the graph version, when the caller has already worked
+		 * out the new length.
 		 */
-		void addFlow(double d, ForwardGraphEdge *fge) {
+		template<typename Graph>
+		void addFlow(double d, double length, Graph& g) {
 			ownFlow += d;
-			fge->addFlow(d);
-			realEdge->setDistance((*fge->costFunction())(fge->getFlow()));
+			g.addFlow(edge, d, length);
 		}
 		
-		BackwardGraphEdge* underlyingEdge() { return realEdge; }
+		unsigned underlyingEdge() const { return edge; }
 	private:
-		BackwardGraphEdge* realEdge;
+		unsigned edge;
+		unsigned from;
 		double ownFlow;
 };
 
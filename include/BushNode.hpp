@@ -27,31 +27,51 @@
 #include <utility>
 
 #include "BushEdge.hpp"
+#include "DistanceKernel.hpp"
 
-class ABGraph;
+template<typename> class CostGraph;
 
-class BushNode
+/**
+ * Min/max distance labels and predecessors for every node, shared by all
+ * the bushes. Stored as separate arrays rather than one struct per node:
+ * updateInDistances only reads the from-nodes' distances, so it shouldn't
+ * drag their predecessors through the cache as well.
+ */
+class BushNodes
 {
 	public:
-		BushNode();
-		void equilibriate(ABGraph&);
-		void updateInDistances(std::vector<BushEdge>::iterator, std::vector<BushEdge>::iterator);
-		double minDist() const { return minDistance; }
-		double maxDist() const { return maxDistance; }
-		double getDifference() const { return (maxDistance-minDistance); }
-		BushEdge* getMinPredecessor() { return minPredecessor; }
-		void setDistance(double d) { minDistance = maxDistance = d; }
+		explicit BushNodes(std::size_t nodes = 0);
+		std::size_t size() const { return minDistance.size(); }
+		/**
+		 * Moves flow from node's max path to its min path, segment by
+		 * segment. Returns whether any moved, beyond rounding noise: none
+		 * can along a max path whose flow has dwindled below what used()
+		 * counts.
+		 */
+		template<typename Cost>
+		bool equilibriate(unsigned node, CostGraph<Cost>&);
+		void updateInDistances(unsigned node, std::vector<BushEdge>::iterator, std::vector<BushEdge>::iterator, const double* lengths);
+		double minDist(unsigned node) const { return minDistance[node]; }
+		double maxDist(unsigned node) const { return maxDistance[node]; }
+		double getDifference(unsigned node) const { return (maxDistance[node]-minDistance[node]); }
+		BushEdge* getMinPredecessor(unsigned node) { return minPredecessor[node]; }
+		void setDistance(unsigned node, double d) { minDistance[node] = maxDistance[node] = d; }
 	private:
-		bool moreSeparatePaths(BushNode*&, BushNode*&, ABGraph&);
-		void fixDifferentPaths(std::vector<std::pair<BushEdge*, ForwardGraphEdge*> >&,
-				       std::vector<std::pair<BushEdge*, ForwardGraphEdge*> >&, double);
+		//Vectorised updateInDistances if the CPU has one. The gathers and the
+		//final reduction across lanes cost more than the scalar loop until
+		//there are quite a few in-arcs, so typical road nodes stay scalar.
+		static const DistanceKernel kernel;
+		static const long kernelMinimumArcs = 8;
 		
-		BushEdge* minPredecessor;
-		BushEdge* maxPredecessor;
-		//TODO: store predecessors elsewhere.
+		bool moreSeparatePaths(unsigned&, unsigned&);
+		template<typename Cost>
+		double fixDifferentPaths(std::vector<BushEdge*>&, std::vector<BushEdge*>&, double, CostGraph<Cost>&);
 		
-		double minDistance;
-		double maxDistance;
+		std::vector<double> minDistance;
+		std::vector<double> maxDistance;
+		
+		std::vector<BushEdge*> minPredecessor;
+		std::vector<BushEdge*> maxPredecessor;
 };
 
 /*
@@ -63,7 +83,7 @@ updateEdges (and possibly topo-sort) as well to make it worthwhile. Still, for
 two threads that beats some other ideas. Don't sacrifice any convergence per
 iteration.
 */
-inline void BushNode::updateInDistances(std::vector<BushEdge>::iterator it, std::vector<BushEdge>::iterator end)
+inline void BushNodes::updateInDistances(unsigned node, std::vector<BushEdge>::iterator it, std::vector<BushEdge>::iterator end, const double* lengths)
 {
 	/*
 	Our rules are as follows:
@@ -83,19 +103,31 @@ inline void BushNode::updateInDistances(std::vector<BushEdge>::iterator it, std:
 	could be costly, though.
 	*/
 	
+	if(kernel && end-it >= kernelMinimumArcs) {
+		InDistances d;
+		kernel(&*it, static_cast<std::size_t>(end-it), lengths, &minDistance[0], &maxDistance[0], d);
+		minDistance[node] = d.minDist;
+		maxDistance[node] = d.maxDist;
+		minPredecessor[node] = &*it + d.minPred;
+		maxPredecessor[node] = &*it + d.maxPred;
+		return;
+	}
+	
 	std::vector<BushEdge>::iterator minPred;
 	std::vector<BushEdge>::iterator maxPred;
 	double minDist = std::numeric_limits<double>::infinity();
 	double maxDist = std::numeric_limits<double>::infinity();
+	const double* minDistances = &minDistance[0];
+	const double* maxDistances = &maxDistance[0];
 
 	for(; it != end; ++it) {
 		
 		//No flow to date.
-		BushNode *fromNode = it->fromNode();
-		double edgeLength = it->length();
+		unsigned fromNode = it->fromNode();
+		double edgeLength = lengths[it->underlyingEdge()];
 		
-		double fromMinDist = fromNode->minDistance + edgeLength;
-		double fromMaxDist = fromNode->maxDistance + edgeLength;
+		double fromMinDist = minDistances[fromNode] + edgeLength;
+		double fromMaxDist = maxDistances[fromNode] + edgeLength;
 		
 		if(minDist > fromMinDist) {
 			minPred = it;
@@ -114,11 +146,11 @@ inline void BushNode::updateInDistances(std::vector<BushEdge>::iterator it, std:
 	}
 	for(; it != end; ++it) {
 		//For when we know we have flow.
-		BushNode *fromNode = it->fromNode();
-		double edgeLength = it->length();
+		unsigned fromNode = it->fromNode();
+		double edgeLength = lengths[it->underlyingEdge()];
 
-		double fromMinDist = fromNode->minDistance + edgeLength;
-		double fromMaxDist = fromNode->maxDistance + edgeLength;
+		double fromMinDist = minDistances[fromNode] + edgeLength;
+		double fromMaxDist = maxDistances[fromNode] + edgeLength;
 		
 		if(minDist > fromMinDist) {
 			minPred = it;
@@ -130,10 +162,10 @@ inline void BushNode::updateInDistances(std::vector<BushEdge>::iterator it, std:
 		}
 	}
 
-	maxDistance = maxDist;
-	minDistance = minDist;
-	maxPredecessor = &*maxPred;
-	minPredecessor = &*minPred;
+	maxDistance[node] = maxDist;
+	minDistance[node] = minDist;
+	maxPredecessor[node] = &*maxPred;
+	minPredecessor[node] = &*minPred;
 	//save our results
 }
 
@@ -0,0 +1,112 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef COST_BATCH_HPP
+#define COST_BATCH_HPP
+
+#include <vector>
+#include <cstddef>
+
+#include "CostFunction.hpp"
+
+/**
+ * A run of cost functions, each with its own flow, evaluated together.
+ * This version is for small concrete cost types (IntegerBPR and friends):
+ * it keeps copies and evaluates them one by one, which inlines down to a
+ * handful of multiplies per term. Cost needs operator(), linear() and
+ * evaluate(x, cost, slope).
+ */
+template<typename Cost>
+class CostBatch
+{
+	public:
+		CostBatch() : straight(true) {}
+		void reserve(std::size_t n) {
+			functions.reserve(n);
+			flows.reserve(n);
+		}
+		void push_back(const Cost* f, double flow) {
+			straight = straight && f->linear();
+			functions.push_back(*f);
+			flows.push_back(flow);
+		}
+		std::size_t size() const { return flows.size(); }
+		/**
+		 * costs[i] = f_i(flow_i + delta).
+		 */
+		void evaluate(double delta, double* costs) const {
+			for(std::size_t i = 0; i < flows.size(); ++i) costs[i] = functions[i](flows[i] + delta);
+		}
+		/**
+		 * Same, along with slopes[i] = f_i'(flow_i + delta).
+		 */
+		void evaluate(double delta, double* costs, double* slopes) const {
+			for(std::size_t i = 0; i < flows.size(); ++i)
+				functions[i].evaluate(flows[i] + delta, costs[i], slopes[i]);
+		}
+		bool linear() const { return straight; }
+	private:
+		bool straight;//All linear
+		std::vector<Cost> functions;
+		std::vector<double> flows;
+};
+
+/**
+ * CostFunctions are too big to copy around, so their parameters are pulled
+ * out into arrays up front. Two kinds of batch get kernels (AVX2 or
+ * AVX-512, picked at run time, with plain loops to fall back on): all
+ * integer-power BPR with one power, the usual TNTP case, and all
+ * fractional BPR on FastPow. Both give the same bits as evaluating each
+ * function on its own. Anything else, exact std::pow included, goes term
+ * by term.
+ */
+template<>
+class CostBatch<CostFunction>
+{
+	public:
+		CostBatch() : power(0), mostTerms(0), uniform(true), fast(true), straight(true) {}
+		void reserve(std::size_t n);
+		void push_back(const CostFunction* f, double flow);
+		std::size_t size() const { return flows.size(); }
+		/**
+		 * costs[i] = f_i(flow_i + delta).
+		 */
+		void evaluate(double delta, double* costs) const;
+		/**
+		 * Same, along with slopes[i] = f_i'(flow_i + delta).
+		 */
+		void evaluate(double delta, double* costs, double* slopes) const;
+		bool linear() const { return straight; }
+	private:
+		void evaluateFast(double delta, double* costs, double* slopes) const;
+		
+		unsigned power, mostTerms;
+		bool uniform;//All BPR_INTEGER with the same power
+		bool fast;//All BPR on FastPow
+		bool straight;//All linear
+		std::vector<const CostFunction*> functions;
+		//CostFunction's a and b for everything, the rest only while fast.
+		std::vector<double> flows, low, high, capacity, zeroFlowTime, extraCost, betaLess;
+		std::vector<unsigned> terms;
+		mutable std::vector<double> scratch, powers;
+};
+
+#endif
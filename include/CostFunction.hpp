@@ -0,0 +1,159 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef COST_FUNCTION_HPP
+#define COST_FUNCTION_HPP
+
+#ifdef _MSC_VER
+ #include <functional>
+ #include <memory>
+#elif defined __PATHCC__
+ #include <boost/tr1/functional.hpp>
+ #include <boost/tr1/memory.hpp>
+#else
+ #include <tr1/functional>
+ #include <tr1/memory>
+#endif
+
+#include <cmath>
+#include "HornerPolynomial.hpp"
+#include "FastPow.hpp"
+
+/**
+ * A link's volume-delay function. Used to be a std::tr1::function, which
+ * meant an indirect call (and 32 bytes) for every cost evaluation. Now it's
+ * a closed set of forms picked apart with a switch the compiler can see
+ * through. Anything else can still go in as a custom function, at the old
+ * price.
+ */
+class CostFunction
+{
+	public:
+		enum Kind { CONSTANT, BPR_INTEGER, BPR, POLYNOMIAL, CUSTOM };
+		
+		/**
+		 * Infinite cost.
+		 */
+		CostFunction();
+		explicit CostFunction(double constant);
+		/**
+		 * BPR function as in the TNTP files:
+		 * extraCost + zeroFlowTime*(1 + alpha*(flow/capacity)^beta).
+		 * Whole-number betas skip pow(). Others use FastPow if powError
+		 * (its largest allowed relative error) is nonzero and achievable.
+		 */
+		CostFunction(double zeroFlowTime, double capacity, double alpha, double beta, double extraCost, double powError = 0);
+		CostFunction(const HornerPolynomial&);
+		/**
+		 * Escape hatch for anything that isn't one of the above.
+		 */
+		explicit CostFunction(const std::tr1::function<double(double)>&);
+		
+		double operator()(double flow) const;
+		/**
+		 * d(cost)/d(flow). Custom functions get a central difference.
+		 */
+		double derivative(double flow) const;
+		/**
+		 * Cost is a + b*flow (or constant).
+		 */
+		bool linear() const;
+		Kind kind() const { return type; }
+		/**
+		 * BPR_INTEGER costs are constantTerm() + scale()*flow^integerPower().
+		 * A CONSTANT's cost is constantTerm(), with scale() 0.
+		 */
+		unsigned integerPower() const { return power; }
+		double constantTerm() const { return a; }
+		double scale() const { return b; }
+		void swap(CostFunction&);
+		/**
+		 * Orders functions by what they compute, so identical links can
+		 * share one. Custom functions only match copies of themselves.
+		 */
+		bool operator<(const CostFunction&) const;
+	private:
+		template<typename> friend class CostBatch;
+		Kind type;
+		unsigned power;//BPR_INTEGER. For BPR, FastPow terms (0: std::pow).
+		//CONSTANT: a. BPR_INTEGER: a + b*flow^power.
+		//BPR: e + t*(1 + a*(flow/c)^b)
+		double a, b, c, t, e;
+		//Out of line so only POLYNOMIAL links pay for its inline coefficients.
+		std::tr1::shared_ptr<const HornerPolynomial> polynomial;
+		std::tr1::shared_ptr<const std::tr1::function<double(double)> > custom;
+};
+
+inline double CostFunction::operator()(double flow) const
+{
+	switch(type) {
+		case BPR_INTEGER: {
+			//Same multiplications, in the same order, as Horner's rule
+			//on the expanded polynomial.
+			double r = b;
+			for(unsigned i = power; i != 1; --i) r *= flow;
+			return r*flow + a;
+		}
+		case BPR: {
+			//Rounding leaves the odd tiny negative flow, and pow() of
+			//a negative number to a fractional power is NaN.
+			double x = flow > 0 ? flow/c : 0;
+			return e + t*(1+a*(power ? FastPow::pow(x, b, power) : std::pow(x, b)));
+		}
+		case CONSTANT:
+			return a;
+		case POLYNOMIAL:
+			return (*polynomial)(flow);
+		default:
+			return (*custom)(flow);
+	}
+}
+
+inline double CostFunction::derivative(double flow) const
+{
+	switch(type) {
+		case BPR_INTEGER: {
+			double r = b*power;
+			for(unsigned i = power; i != 1; --i) r *= flow;
+			return r;
+		}
+		case BPR: {
+			double x = flow > 0 ? flow/c : 0;
+			return t*a*b*(power ? FastPow::pow(x, b-1, power) : std::pow(x, b-1))/c;
+		}
+		case CONSTANT:
+			return 0;
+		case POLYNOMIAL:
+			return polynomial->derivative(flow);
+		default: {
+			double h = 1e-6*(std::fabs(flow) + 1);
+			return ((*custom)(flow+h) - (*custom)(flow-h))/(2*h);
+		}
+	}
+}
+
+inline bool CostFunction::linear() const
+{
+	return type == CONSTANT || (type == BPR_INTEGER && power == 1) ||
+		(type == POLYNOMIAL && polynomial->degree() <= 1);
+}
+
+#endif
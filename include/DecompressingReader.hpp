@@ -0,0 +1,93 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DECOMPRESSING_READER_HPP
+#define DECOMPRESSING_READER_HPP
+
+#include <vector>
+#include <deque>
+#include <cstddef>
+
+#include "MThread.hpp"
+
+/**
+ * Decompresses a gzip (or, built with EF_HAVE_ZSTD, zstd) file on its own
+ * thread and hands the result to the parser in blocks. Every block ends at
+ * a newline, so TNTP rows and tags never straddle two blocks. Only a few
+ * blocks are buffered at a time - we never hold the whole decompressed file.
+ * Files that aren't compressed come back as a single block, straight out of
+ * the original buffer, so the importer can treat everything the same way.
+ */
+class DecompressingReader
+{
+	public:
+		enum Format { NONE, GZIP, ZSTD };
+
+		/**
+		 * Sniffs the magic number at the start of a file.
+		 */
+		static Format format(const char* begin, const char* end);
+
+		/**
+		 * Starts decompressing [begin, end) in the background if it is
+		 * compressed. The buffer has to stay alive until the reader is
+		 * destroyed.
+		 */
+		DecompressingReader(const char* begin, const char* end);
+		~DecompressingReader();
+
+		/**
+		 * Points [blockBegin, blockEnd) at the next block, which stays
+		 * valid until the next call. Returns false when there's nothing
+		 * left. Throws if the data turned out to be corrupt.
+		 */
+		bool next(const char*& blockBegin, const char*& blockEnd);
+
+		/**
+		 * Thread entry point, not for general use.
+		 */
+		void operator()();
+	private:
+		DecompressingReader(const DecompressingReader&);
+		DecompressingReader& operator=(const DecompressingReader&);
+
+		static const std::size_t blockSize = 4 << 20;
+		static const std::size_t maxQueued = 4;
+
+		//Producer side: cuts out at the last newline and queues the rest.
+		//Returns false if the consumer has gone away.
+		bool emit(std::vector<char>& block, bool last);
+		void inflateGzip();
+		void inflateZstd();
+
+		const char* begin;
+		const char* end;
+		Format type;
+
+		std::deque<std::vector<char> > blocks;
+		std::vector<char> current;//The one the parser is looking at
+		bool finished, cancelled;
+		const char* error;
+		MMutex mutex;
+		MCondition changed;
+		MThread thread;
+};
+
+#endif
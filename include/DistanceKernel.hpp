@@ -0,0 +1,53 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DISTANCE_KERNEL_HPP
+#define DISTANCE_KERNEL_HPP
+
+#include <cstddef>
+
+#include "BushEdge.hpp"
+
+/**
+ * What updateInDistances works out for one node. Predecessors are offsets
+ * from the first in-arc.
+ */
+struct InDistances {
+	double minDist, maxDist;
+	std::size_t minPred, maxPred;
+};
+
+/**
+ * A vectorised updateInDistances: same rules, same answers (ties go to the
+ * earliest arc, just like the scalar loop), but it gathers the from-node
+ * labels and edge lengths for several in-arcs at once.
+ */
+typedef void (*DistanceKernel)(const BushEdge* arcs, std::size_t count,
+	const double* lengths, const double* minDistances, const double* maxDistances,
+	InDistances& result);
+
+/**
+ * The widest kernel this CPU can run (AVX-512, then AVX2), or null if there
+ * isn't one and the scalar loop should be used. Building with EF_NO_SIMD
+ * always gives null.
+ */
+DistanceKernel selectDistanceKernel();
+
+#endif
@@ -0,0 +1,113 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef FAST_POW_HPP
+#define FAST_POW_HPP
+
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <limits>
+#include <stdint.h>
+
+/**
+ * x^y as 2^(y*log2 x), with both halves as short series instead of calls
+ * into libm. For BPR links with fractional betas, where std::pow is most of
+ * the cost of a line search.
+ *
+ * log2 of the mantissa (taken in [sqrt(1/2), sqrt(2))) uses the first terms
+ * terms of the atanh series, and 2^f for the fractional part f (in [-1/2,
+ * 1/2]) a Taylor polynomial of degree terms+3, which keeps its error below
+ * the log's. There are no table lookups, and the only branches are for
+ * inputs we hand to std::pow instead (zero, denormals, infinities, huge
+ * results), so loops over it can vectorise.
+ *
+ * errorBound() is an upper bound on the relative error for a given
+ * exponent: the two series remainders, plus some rounding. termsFor() picks
+ * the fewest terms that meet a requested bound.
+ *
+ * The array version does a whole batch with AVX2 or AVX-512 where the CPU
+ * has them, and gives the same bits as calling pow() on each.
+ */
+class FastPow
+{
+	public:
+		static const unsigned maxTerms = 10;
+		
+		static double pow(double x, double y, unsigned terms);
+		/**
+		 * out[i] = pow(x[i], y[i], terms[i]) for i < n. mostTerms is the
+		 * largest of the terms.
+		 */
+		static void pow(std::size_t n, const double* x, const double* y, const unsigned* terms, unsigned mostTerms, double* out);
+		static double errorBound(unsigned terms, double y);
+		/**
+		 * Fewest terms with errorBound(terms, y) <= maxRelativeError, or 0
+		 * (use std::pow) if even maxTerms won't do.
+		 */
+		static unsigned termsFor(double maxRelativeError, double y);
+	private:
+		static const double inverseOdd[maxTerms];//1/(2k+1)
+		static const double inverseFactorial[maxTerms+4];//1/k!
+};
+
+inline double FastPow::pow(double x, double y, unsigned terms)
+{
+	const double sqrt2 = 1.4142135623730951;
+	const double twoOverLn2 = 2.8853900817779268;
+	const double ln2 = 0.69314718055994531;
+	
+	if(!(x >= std::numeric_limits<double>::min() && x <= std::numeric_limits<double>::max()))
+		return std::pow(x, y);
+	
+	//x = m*2^exponent, m in [1, 2), then pulled into [sqrt(1/2), sqrt(2)).
+	uint64_t bits;
+	std::memcpy(&bits, &x, sizeof bits);
+	double exponent = static_cast<double>(static_cast<int>(bits >> 52) - 1023);
+	bits = (bits & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL;
+	double m;
+	std::memcpy(&m, &bits, sizeof m);
+	if(m > sqrt2) {
+		m *= 0.5;
+		exponent += 1;
+	}
+	
+	//log2(m) = 2/ln2 * atanh(s), s = (m-1)/(m+1) in about +-0.1716
+	double s = (m-1)/(m+1);
+	double s2 = s*s;
+	double sum = 0;
+	for(unsigned k = terms; k != 0; --k) sum = sum*s2 + inverseOdd[k-1];
+	double z = y*(exponent + twoOverLn2*s*sum);
+	
+	if(!(std::fabs(z) < 1000)) return std::pow(x, y);
+	
+	//2^z = 2^n * e^(f ln2), f in [-1/2, 1/2]
+	double n = std::floor(z + 0.5);
+	double g = (z - n)*ln2;
+	double r = 0;
+	for(unsigned k = terms+4; k != 0; --k) r = r*g + inverseFactorial[k-1];
+	uint64_t scale = static_cast<uint64_t>(static_cast<int64_t>(n) + 1023) << 52;
+	double twoN;
+	std::memcpy(&twoN, &scale, sizeof twoN);
+	return r*twoN;
+}
+
+#endif
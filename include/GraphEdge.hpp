@@ -24,53 +24,44 @@
 #include <ostream>
 #include <vector>
 #include <limits>
-#include "InputGraph.hpp"
-
-class BushNode;
 
 /*
 Split edges for cache gains. Should bring GraphEdges from 4.32MB total in CR's
 BuildTrees to ~1.5MB
+Edges refer to nodes and to each other by 32-bit index now, not by pointer.
+Both halves of an edge share the same index in ABGraph, which also keeps the
+lengths and cost functions in their own arrays - only the lengths are hot.
 */
 
 class BackwardGraphEdge
 {
 	public:
-		BackwardGraphEdge() : from(0), _distance(0.0) {}
-		BackwardGraphEdge(double, BushNode *from);
-		BackwardGraphEdge(const BackwardGraphEdge & e);
+		BackwardGraphEdge() : from(0) {}
+		explicit BackwardGraphEdge(unsigned from);
 
-		double distance() const { return _distance; }
-		void setDistance(double d) { _distance = d; }
-		BushNode* fromNode() { return from; }
+		unsigned fromNode() const { return from; }
 	private:
-		friend class ForwardGraphEdge;
-		BushNode* from;
-		double _distance;
+		unsigned from;
 };
 
 class ForwardGraphEdge
 {
 	public:
-		ForwardGraphEdge() : inverse(0), to(0), flow(0.0) {}
+		ForwardGraphEdge() : to(0), inverse(0), flow(0.0) {}
 
-		ForwardGraphEdge(InputGraph::VDF, BushNode* to, BackwardGraphEdge* inverse=0);
-		ForwardGraphEdge(const ForwardGraphEdge& e);
-		
-		const InputGraph::VDF* costFunction() const { return &distanceFunction; }
+		explicit ForwardGraphEdge(unsigned to, unsigned inverse=0);
 
-		BushNode* toNode() { return to; }
+		unsigned toNode() const { return to; }
 
-		void setInverse(BackwardGraphEdge* ge) { inverse = ge; }
-		BackwardGraphEdge* getInverse() { return inverse; }
+		void setInverse(unsigned e) { inverse = e; }
+		unsigned getInverse() const { return inverse; }
 		void addFlow(double d) {
 			flow += d;
 		}
 		double getFlow() const { return flow; }
 	private:
-		InputGraph::VDF distanceFunction;//Dang, 32 bytes in GCC!?
-		BackwardGraphEdge* inverse;
-		BushNode* to;
+		unsigned to;
+		unsigned inverse;
 		double flow;
 };
 
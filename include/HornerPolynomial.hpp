@@ -18,21 +18,39 @@
 */
 
 
+
 #ifndef HORNER_POLYNOMIAL_HPP
 #define HORNER_POLYNOMIAL_HPP
 
 #include <vector>
 #include <ostream>
+#include <cstddef>
 
+/**
+ * Polynomial in coefficient form, evaluated by Horner's rule. Coefficients
+ * up to degree maxInlineDegree live in the object itself, so evaluating one
+ * doesn't chase a pointer and copying one doesn't allocate. Anything higher
+ * goes on the heap.
+ */
 class HornerPolynomial
 {
+	public:
+		static const std::size_t maxInlineDegree = 8;
 	private:
-		std::vector<double> coeffs;
+		static const std::size_t inlineTerms = maxInlineDegree+1;
+		std::size_t terms;
+		double local[inlineTerms];
+		std::vector<double> spill;//Only used past maxInlineDegree.
+		
+		double* coefficients() { return terms > inlineTerms ? &spill[0] : local; }
+		const double* coefficients() const { return terms > inlineTerms ? &spill[0] : local; }
+		void resize(std::size_t);//New coefficients are zero.
 	public:
-		HornerPolynomial() {}
-		HornerPolynomial(const std::vector<double>& coeffs) : coeffs(coeffs) {}
-		HornerPolynomial(const HornerPolynomial& h) : coeffs(h.coeffs) {}//Maybe remove? Can't remember why I did before...
+		HornerPolynomial() : terms(0) {}
+		HornerPolynomial(const std::vector<double>& coeffs);
 		double operator()(double x) const;
+		double derivative(double x) const;
+		std::size_t degree() const { return terms ? terms-1 : 0; }
 		void operator+=(const HornerPolynomial&);
 		void operator-=(const HornerPolynomial&);
 		void operator*=(double);
@@ -40,15 +58,45 @@ class HornerPolynomial
 		void shiftX(double);
 		void shiftXInc(double);
 		void multiplyX(double);
-		friend std::ostream& operator<<(std::ostream& o, HornerPolynomial & e)
+		void swap(HornerPolynomial&);
+		/**
+		 * Some strict ordering (by degree, then coefficients), so equal
+		 * polynomials can be found and shared.
+		 */
+		bool operator<(const HornerPolynomial&) const;
+		friend std::ostream& operator<<(std::ostream& o, const HornerPolynomial & e)
 		{
 			o << "Horner Polynomial:";
-			unsigned u = 0;
-			for(std::vector<double>::iterator i = e.coeffs.begin(); i != e.coeffs.end(); ++i)
-				o << " + " << (*i) << "x^" << u++;
+			const double* c = e.coefficients();
+			for(std::size_t u = 0; u < e.terms; ++u)
+				o << " + " << c[u] << "x^" << u;
 			return o;
 		}//FIXME
 		
 };
 
+inline double HornerPolynomial::operator()(double x) const
+{
+	const double* c = coefficients();
+	double result = 0;
+	//Unrolled for the inline sizes; falls through from the top coefficient.
+	switch(terms) {
+		case 9: result = result*x + c[8];
+		case 8: result = result*x + c[7];
+		case 7: result = result*x + c[6];
+		case 6: result = result*x + c[5];
+		case 5: result = result*x + c[4];
+		case 4: result = result*x + c[3];
+		case 3: result = result*x + c[2];
+		case 2: result = result*x + c[1];
+		case 1: result = result*x + c[0];
+		case 0: return result;
+	}
+	for(std::size_t i = terms; i != 0; --i) {
+		result *= x;
+		result += c[i-1];
+	}
+	return result;
+}
+
 #endif
@@ -1,47 +1,105 @@
 #ifndef INPUT_GRAPH_HPP
 #define INPUT_GRAPH_HPP
 
-#include <map>
+#include <vector>
 #include <utility>
 
-#ifdef _MSC_VER
- #include <functional>
-#elif defined __PATHCC__
- #include <boost/tr1/functional.hpp>
-#else
- #include <tr1/functional>
-#endif
+#include "CostFunction.hpp"
 
+/**
+ * Flat builder for the imported network and trip table. Edges and demand
+ * are appended as they're read and sorted/merged once, by finalise(),
+ * into contiguous arrays ordered by (from, to). Used to be a map of maps,
+ * which cost a heap node per link and per OD pair.
+ */
 class InputGraph {
 	public:
-		InputGraph() {}
-		typedef std::tr1::function<double(double)> VDF;
+		typedef CostFunction VDF;
+
+		struct Edge {
+			Edge(unsigned from, unsigned to) : from(from), to(to) {}
+			unsigned from, to;
+			VDF vdf;
+		};
+		struct Demand {
+			Demand(unsigned from, unsigned to, double amount) : from(from), to(to), amount(amount) {}
+			unsigned from, to;
+			double amount;
+		};
 
+		InputGraph() : nodes(0), finalised(true) {}
+
+		/**
+		 * Adds a link. If the same link is added twice the last one wins.
+		 */
 		void addEdge(unsigned from, unsigned to, VDF vdf) {
-			_graph[from][to] = vdf;
+			pendingEdges.push_back(EdgeKey(from, to, static_cast<unsigned>(pendingFunctions.size())));
+			pendingFunctions.push_back(VDF());
+			pendingFunctions.back().swap(vdf);
+			finalised = false;
 		}
+		/**
+		 * Adds demand. Repeated OD pairs are summed.
+		 */
 		void addDemand(unsigned from, unsigned to, double demand) {
-			_demand[from][to] += demand;
+			_demand.push_back(Demand(from, to, demand));
+			finalised = false;
+		}
+		/**
+		 * Hints for the importers so we don't reallocate all the time.
+		 */
+		void reserve(std::size_t edges, std::size_t odPairs) {
+			pendingEdges.reserve(edges);
+			pendingFunctions.reserve(edges);
+			_demand.reserve(odPairs);
 		}
-		const std::map<unsigned,std::map<unsigned, VDF> >& graph() const {
+
+		/**
+		 * Links, sorted by from-node then to-node. Only once finalised;
+		 * plain reads after that, so any number of threads can share a
+		 * finished graph.
+		 */
+		const std::vector<Edge>& graph() const {
+			if(!finalised) throw "InputGraph read before finalise()";
 			return _graph;
 		}
-		const std::map<unsigned,std::map<unsigned, double> >& demand() const {
+		/**
+		 * OD pairs with nonzero demand entries, sorted by origin then
+		 * destination, so each origin's destinations are contiguous.
+		 */
+		const std::vector<Demand>& demand() const {
+			if(!finalised) throw "InputGraph read before finalise()";
 			return _demand;
 		}
 		unsigned numNodes() const { return nodes; }
 		void setNodes(unsigned u) { nodes = u; }
-		//TODO: fix/lock/finalise?
-		
+
+		/**
+		 * Sorts and merges everything added so far and frees up the
+		 * builder's scratch space. The importers call it when they're
+		 * done; anyone else adding to the graph has to as well.
+		 */
+		void finalise();
+
 		// NOTE: specs should come from GraphImporter.cpp, ABGraph.cpp
 		//and maybe some graph classes in TAPFramework.
 	private:
+		struct EdgeKey {
+			EdgeKey(unsigned from, unsigned to, unsigned sequence) : from(from), to(to), sequence(sequence) {}
+			bool operator<(const EdgeKey& e) const {
+				if(from != e.from) return from < e.from;
+				if(to != e.to) return to < e.to;
+				return sequence < e.sequence;
+			}
+			unsigned from, to, sequence;
+		};
+
 		unsigned nodes;
-		std::map<unsigned, std::map<unsigned, VDF> > _graph;
-		//map[from_node] --> (map[to_node] --> delay_func)
-		
-		std::map<unsigned, std::map<unsigned, double> > _demand;
-		//map[from_node] --> (map[to_node] --> demand)
+		bool finalised;
+		std::vector<EdgeKey> pendingEdges;
+		std::vector<VDF> pendingFunctions;
+		std::vector<Edge> _graph;
+		std::vector<Demand> _demand;
 };
 
 #endif
@@ -0,0 +1,78 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef INTEGER_BPR_HPP
+#define INTEGER_BPR_HPP
+
+#include <limits>
+
+#include "CostFunction.hpp"
+
+/**
+ * a + b*flow^Power with Power fixed at compile time. Almost every network
+ * out there is BPR with beta = 4, and with the power known the multiply
+ * chain unrolls and there's no switch on the function's kind. The solver
+ * gets instantiated on this when every link fits (see fits()), and on
+ * CostFunction otherwise.
+ */
+template<unsigned Power>
+class IntegerBPR
+{
+	public:
+		/**
+		 * Infinite cost, like CostFunction's default.
+		 */
+		IntegerBPR() : a(std::numeric_limits<double>::infinity()), b(0) {}
+		/**
+		 * Constants fit too, as b = 0.
+		 */
+		explicit IntegerBPR(const CostFunction& f) : a(f.constantTerm()), b(f.scale()) {}
+		static bool fits(const CostFunction& f) {
+			return f.kind() == CostFunction::CONSTANT ||
+				(f.kind() == CostFunction::BPR_INTEGER && f.integerPower() == Power);
+		}
+		
+		//Same multiplications, in the same order, as CostFunction.
+		double operator()(double flow) const {
+			double r = b;
+			for(unsigned i = Power; i != 1; --i) r *= flow;
+			return r*flow + a;
+		}
+		double derivative(double flow) const {
+			double cost, slope;
+			evaluate(flow, cost, slope);
+			return slope;
+		}
+		/**
+		 * Both at once, b*flow^(Power-1) being on the way to the cost.
+		 */
+		void evaluate(double flow, double& cost, double& slope) const {
+			double r = b;
+			for(unsigned i = Power; i != 1; --i) r *= flow;
+			slope = Power*r;
+			cost = r*flow + a;
+		}
+		bool linear() const { return Power == 1 || b == 0; }
+	private:
+		double a, b;
+};
+
+#endif
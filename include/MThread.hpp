@@ -0,0 +1,218 @@
+/*
+ * Same idea as MTimer: just enough threading to get by without Boost.
+ * POSIX threads underneath, so link with pthread on Linux.
+ * Without pthreads we just run the task in start() and join() does
+ * nothing - everything still works, it just doesn't go any faster.
+ */
+
+#ifndef MTHREAD_HPP
+#define MTHREAD_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#ifdef _MSC_VER
+	class MThread {
+	public:
+		template<typename T>
+		void start(T& task) { task(); }
+		template<typename T>
+		bool spawn(T&) { return false; }
+		void join() {}
+		static unsigned hardwareThreads() { return 1; }
+	};
+	//Only one thread ever runs, so there's nothing to lock.
+	class MMutex {
+	public:
+		void lock() {}
+		void unlock() {}
+	};
+	class MCondition {
+	public:
+		void wait(MMutex&) {}
+		void signal() {}
+		void broadcast() {}
+	};
+#else
+	#include <pthread.h>
+	#include <unistd.h>
+	class MThread {
+	public:
+		MThread() : running(false) {}
+		~MThread() { join(); }
+		/**
+		 * Runs task() on a new thread. task must outlive the thread.
+		 */
+		template<typename T>
+		void start(T& task) {
+			if(!spawn(task)) task();//Couldn't get a thread, do it ourselves.
+		}
+		/**
+		 * Like start(), but if there's no thread to be had, returns false
+		 * and leaves task alone.
+		 */
+		template<typename T>
+		bool spawn(T& task) {
+			join();
+			if(pthread_create(&thread, 0, &MThread::run<T>, &task) != 0) return false;
+			running = true;
+			return true;
+		}
+		void join() {
+			if(running) pthread_join(thread, 0);
+			running = false;
+		}
+		static unsigned hardwareThreads() {
+			long n = sysconf(_SC_NPROCESSORS_ONLN);
+			return n > 0 ? static_cast<unsigned>(n) : 1;
+		}
+	private:
+		MThread(const MThread&);
+		MThread& operator=(const MThread&);
+
+		template<typename T>
+		static void* run(void* task) {
+			(*static_cast<T*>(task))();
+			return 0;
+		}
+		pthread_t thread;
+		bool running;
+	};
+	class MCondition;
+	class MMutex {
+	public:
+		MMutex() { pthread_mutex_init(&mutex, 0); }
+		~MMutex() { pthread_mutex_destroy(&mutex); }
+		void lock() { pthread_mutex_lock(&mutex); }
+		void unlock() { pthread_mutex_unlock(&mutex); }
+	private:
+		friend class MCondition;
+		MMutex(const MMutex&);
+		MMutex& operator=(const MMutex&);
+		pthread_mutex_t mutex;
+	};
+	class MCondition {
+	public:
+		MCondition() { pthread_cond_init(&condition, 0); }
+		~MCondition() { pthread_cond_destroy(&condition); }
+		/**
+		 * Caller must hold m. Spurious wakeups happen, so loop.
+		 */
+		void wait(MMutex& m) { pthread_cond_wait(&condition, &m.mutex); }
+		void signal() { pthread_cond_signal(&condition); }
+		void broadcast() { pthread_cond_broadcast(&condition); }
+	private:
+		MCondition(const MCondition&);
+		MCondition& operator=(const MCondition&);
+		pthread_cond_t condition;
+	};
+#endif
+
+/**
+ * Holds a mutex for the rest of the scope.
+ */
+class MLock {
+public:
+	MLock(MMutex& m) : m(m) { m.lock(); }
+	~MLock() { m.unlock(); }
+private:
+	MLock(const MLock&);
+	MLock& operator=(const MLock&);
+	MMutex& m;
+};
+
+/**
+ * Threads that wait around between jobs, for work that comes in lots of
+ * short bursts: starting threads for every one can cost more than the
+ * work. run() does the first task itself and gives each worker one of the
+ * rest, returning once they're all done. Tasks left over when there are
+ * no more workers (or no threads at all) get done in run() as well.
+ */
+class MWorkers {
+public:
+	/**
+	 * Enough for run()s of up to size tasks at once.
+	 */
+	explicit MWorkers(std::size_t size) : threads(size > 1 ? size-1 : 0), workers(threads.size()),
+		jobs(threads.size()), started(0), pending(0), round(0), quitting(false)
+	{
+		for(; started < workers.size(); ++started) {
+			workers[started].pool = this;
+			workers[started].index = started;
+			if(!threads[started].spawn(workers[started])) break;
+		}
+	}
+	~MWorkers() {
+		{
+			MLock l(mutex);
+			quitting = true;
+			wake.broadcast();
+		}
+		for(std::size_t i = 0; i < started; ++i) threads[i].join();
+	}
+	template<typename T>
+	void run(std::vector<T>& tasks, std::size_t count) {
+		std::size_t handed = count > 1 ? std::min(count-1, started) : 0;
+		if(handed) {
+			MLock l(mutex);
+			for(std::size_t i = 0; i < handed; ++i) {
+				jobs[i].call = &call<T>;
+				jobs[i].task = &tasks[i+1];
+			}
+			pending = handed;
+			++round;
+			wake.broadcast();
+		}
+		for(std::size_t i = 0; i < count; ++i)
+			if(i == 0 || i > handed) tasks[i]();
+		if(handed) {
+			MLock l(mutex);
+			while(pending) done.wait(mutex);
+		}
+	}
+private:
+	MWorkers(const MWorkers&);
+	MWorkers& operator=(const MWorkers&);
+	
+	struct Job {
+		Job() : call(0), task(0) {}
+		void (*call)(void*);
+		void* task;
+	};
+	template<typename T>
+	static void call(void* task) { (*static_cast<T*>(task))(); }
+	
+	struct Worker {
+		void operator()() {
+			unsigned long seen = 0;
+			pool->mutex.lock();
+			while(true) {
+				while(pool->round == seen && !pool->quitting) pool->wake.wait(pool->mutex);
+				if(pool->quitting) break;
+				seen = pool->round;
+				Job job = pool->jobs[index];
+				if(!job.call) continue;//Nothing for us this time.
+				pool->jobs[index] = Job();
+				pool->mutex.unlock();
+				job.call(job.task);
+				pool->mutex.lock();
+				if(--pool->pending == 0) pool->done.signal();
+			}
+			pool->mutex.unlock();
+		}
+		MWorkers* pool;
+		std::size_t index;
+	};
+	
+	MMutex mutex;
+	MCondition wake, done;
+	std::vector<MThread> threads;
+	std::vector<Worker> workers;
+	std::vector<Job> jobs;
+	std::size_t started, pending;
+	unsigned long round;
+	bool quitting;
+};
+
+#endif
@@ -0,0 +1,50 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Read-only view of a whole file. On POSIX systems the file is mmapped so
+ * the importer can tokenize straight out of the page cache without copying
+ * anything through an istream. Elsewhere we just read the file into memory.
+ */
+class MappedFile
+{
+	public:
+		MappedFile(const char* path);
+		~MappedFile();
+
+		const char* begin() const { return data; }
+		const char* end() const { return data+length; }
+		std::size_t size() const { return length; }
+	private:
+		MappedFile(const MappedFile&);//No copying, we own the mapping.
+		MappedFile& operator=(const MappedFile&);
+
+		const char* data;
+		std::size_t length;
+		std::vector<char> fallback;//Only used when we can't (or needn't) mmap.
+};
+
+#endif
@@ -0,0 +1,106 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef NETWORK_CACHE_HPP
+#define NETWORK_CACHE_HPP
+
+#include <vector>
+#include <string>
+#include <cstddef>
+#include <stdint.h>
+
+#include "InputGraph.hpp"
+
+class MappedFile;
+
+/**
+ * Binary snapshot of an imported network and trip table, so repeated runs
+ * on the same scenario can skip the text parser entirely.
+ *
+ * Layout (host endian, every array padded to 8 bytes):
+ *   Header
+ *   uint32 linkOffsets[nodes+1]   CSR over from-nodes
+ *   uint32 linkTo[links]
+ *   double zeroFlowTime[links], capacity[links], alpha[links],
+ *          beta[links], extraCost[links]
+ *   uint32 origins[numOrigins]
+ *   uint32 demandOffsets[numOrigins+1]
+ *   uint32 destinations[odPairs]
+ *   double demand[odPairs]
+ *
+ * The header remembers the sizes and modification times (to the
+ * nanosecond) of the text files and the cost factors it was built with. If
+ * any of those change the cache is stale and we reparse. So we do if the
+ * cache is cut short or its arrays don't make sense.
+ */
+class NetworkCache
+{
+	public:
+		/**
+		 * Link data as the importer read it (ids already zero-based and
+		 * zone-adjusted). The cache needs BPR parameters, not the VDF.
+		 */
+		struct Link {
+			unsigned from, to;
+			double zeroFlowTime, capacity, alpha, beta, extraCost;
+		};
+
+		NetworkCache(const char* cacheFile, const char* networkFile, const char* tripsFile, double distanceCost, double tollCost);
+
+		/**
+		 * Fills graph from the cache. Returns false (leaving graph alone)
+		 * if there's no cache or it's stale or damaged. powError is passed on to the
+		 * CostFunctions.
+		 */
+		bool load(InputGraph& graph, double powError = 0);
+
+		/**
+		 * Writes a new cache. Links in the order read, later duplicates
+		 * replace earlier ones like they do in InputGraph.
+		 */
+		void save(const InputGraph& graph, std::vector<Link>& links);
+
+		std::size_t size() const { return cacheSize; }
+	private:
+		static const uint32_t version = 2;
+
+		struct Header {
+			char magic[8];
+			uint32_t version;
+			uint32_t byteOrder;
+			uint64_t networkSize, networkTime;
+			uint64_t tripsSize, tripsTime;
+			double distanceCost, tollCost;
+			uint32_t nodes, links;
+			uint32_t origins, odPairs;
+		};
+
+		void fillHeader(Header&) const;
+		bool load(const MappedFile&, InputGraph&, double);
+
+		std::string cacheFile;
+		std::string networkFile;
+		std::string tripsFile;
+		double distanceCost;
+		double tollCost;
+		std::size_t cacheSize;
+};
+
+#endif
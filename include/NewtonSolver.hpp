@@ -0,0 +1,105 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef NEWTON_SOLVER_HPP
+#define NEWTON_SOLVER_HPP
+
+#include <cmath>
+
+/**
+ * Finds the root of an increasing function between two bounds with
+ * Newton's method, falling back to bisection whenever a Newton step would
+ * leave the bracket or stalls. T needs operator()(x) and operator()(x, value, slope),
+ * plus linear(): if that's true the first Newton step is the exact answer
+ * and we stop there.
+ * Drop-in for SecantSolver: same solve() arguments, same answers at the
+ * ends (lower if f(lower) > 0, upper if f(upper) < 0).
+ */
+template<typename T>
+class NewtonSolver
+{
+	public:
+		NewtonSolver(unsigned=50);
+		double solve(const T&, double=0.0, double=1.0);
+	private:
+		unsigned iterationLimit;
+};
+
+template<typename T>
+NewtonSolver<T>::NewtonSolver(unsigned iterations):iterationLimit(iterations) {}
+
+template<typename T>
+double NewtonSolver<T>::solve(const T& p, double upper, double lower)
+{
+	double value, slope;
+	p(lower, value, slope);
+	if(value > 0) return lower;
+	if(p.linear()) {
+		//Straight line, so one step lands on the root.
+		if(!(slope > 0)) return value < 0 ? upper : lower;
+		double x = lower - value/slope;
+		return x < upper ? x : upper;
+	}
+	
+	//Safeguarded as in Numerical Recipes' rtsafe: bisect whenever the
+	//Newton step leaves the bracket or isn't shrinking things fast enough.
+	//The max segment's term is concave, so plain Newton can cycle.
+	//We don't look at f(upper) until a step wants to go past it, which
+	//saves an evaluation most of the time.
+	double x = lower;
+	bool bracketed = false;
+	double step = upper-lower, lastStep = step;
+	//Near a root the cost differences are all rounding noise, so stop once
+	//steps are that small next to the whole range.
+	double tolerance = 1e-12*(upper-lower);
+	for(unsigned i = 0; i < iterationLimit; ++i) {
+		if(value == 0) return x;
+		if(value < 0) lower = x;
+		else {
+			upper = x;
+			bracketed = true;
+		}
+		
+		double next = x - value/slope;
+		if(!bracketed && !(next < upper)) {
+			lastStep = step;
+			step = upper - x;
+			x = upper;
+			p(x, value, slope);
+			if(value <= 0) return x;
+			continue;
+		}
+		if(!(next > lower && next < upper) || std::fabs(2*value) > std::fabs(lastStep*slope)) {
+			lastStep = step;
+			step = (upper-lower)/2;
+			x = lower + step;
+		} else {
+			lastStep = step;
+			step = x - next;
+			x = next;
+		}
+		if(std::fabs(step) <= tolerance + 1e-15*std::fabs(x)) return x;
+		p(x, value, slope);
+	}
+	return x;
+}
+
+#endif
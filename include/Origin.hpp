@@ -34,6 +34,10 @@ class Origin
 		
 		int getOrigin() const { return origin; }
 		void addDestination(int, double);
+		/**
+		 * Swaps every node id for ids[id].
+		 */
+		void renumber(const std::vector<unsigned>& ids);
 		
 		friend std::ostream& operator<<(std::ostream& o, Origin & p) {
 			o << "Origin["<<p.origin<<",some destinations]";
@@ -0,0 +1,81 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef ORIGIN_QUEUE_HPP
+#define ORIGIN_QUEUE_HPP
+
+#include <list>
+
+#include "Origin.hpp"
+#include "MThread.hpp"
+
+/**
+ * Hands origins from the trips parser to the solver as soon as each Origin
+ * block has been read, so bush construction overlaps with the rest of the
+ * import. Unbounded: parsing is much faster than building bushes, and the
+ * origins have to live somewhere anyway.
+ */
+class OriginQueue
+{
+	public:
+		OriginQueue() : closed(false) {}
+
+		void push(const Origin& o) {
+			MLock l(mutex);
+			origins.push_back(o);
+			ready.signal();
+		}
+		/**
+		 * Moves everything in other onto the end of the queue, in order.
+		 * Nobody else can be using other any more.
+		 */
+		void append(OriginQueue& other) {
+			MLock l(mutex);
+			origins.splice(origins.end(), other.origins);
+			ready.broadcast();
+		}
+		/**
+		 * No more origins are coming. Wakes up anyone waiting.
+		 */
+		void close() {
+			MLock l(mutex);
+			closed = true;
+			ready.broadcast();
+		}
+		/**
+		 * Moves the next origin onto the back of out (no copying), waiting
+		 * for one if necessary. Returns false once the queue is closed and
+		 * empty.
+		 */
+		bool pop(std::list<Origin>& out) {
+			MLock l(mutex);
+			while(origins.empty() && !closed) ready.wait(mutex);
+			if(origins.empty()) return false;
+			out.splice(out.end(), origins, origins.begin());
+			return true;
+		}
+	private:
+		std::list<Origin> origins;
+		bool closed;
+		MMutex mutex;
+		MCondition ready;
+};
+
+#endif
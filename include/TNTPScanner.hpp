@@ -0,0 +1,156 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TNTP_SCANNER_HPP
+#define TNTP_SCANNER_HPP
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+/**
+ * Tokenizer for Bar-Gera's TNTP files working straight out of a character
+ * buffer (usually an mmapped file). Replaces the istream extraction we used
+ * to do, which spent most of its time in locale and sentry code.
+ * Never reads past end, never copies unless a number is too awkward to scan
+ * exactly by hand.
+ */
+class TNTPScanner
+{
+	public:
+		TNTPScanner(const char* begin, const char* end) : pos(begin), end(end) {}
+
+		bool atEnd() const { return pos >= end; }
+		char peek() const { return pos < end ? *pos : '\0'; }
+		const char* position() const { return pos; }
+
+		/**
+		 * Skips whitespace and '~' comments (which run to end of line).
+		 */
+		void skipComments() {
+			while(pos < end) {
+				if(isSpace(*pos)) ++pos;
+				else if(*pos == '~') skipLine();
+				else return;
+			}
+		}
+
+		/**
+		 * Moves to just past the next occurrence of c (or the end).
+		 */
+		void skipPast(char c) {
+			const void* found = std::memchr(pos, c, static_cast<std::size_t>(end-pos));
+			pos = found ? static_cast<const char*>(found)+1 : end;
+		}
+		void skipLine() { skipPast('\n'); }
+
+		/**
+		 * Skips a run of letters, e.g. the "Origin" keyword.
+		 */
+		void skipWord() {
+			while(pos < end && ((*pos >= 'a' && *pos <= 'z') || (*pos >= 'A' && *pos <= 'Z'))) ++pos;
+		}
+
+		/**
+		 * Reads a metadata tag like "<NUMBER OF NODES>" into name. Returns
+		 * false if the next token isn't a tag.
+		 */
+		bool readTag(std::string& name) {
+			skipComments();
+			if(peek() != '<') return false;
+			const char* start = ++pos;
+			skipPast('>');
+			name.assign(start, pos-1);
+			return true;
+		}
+
+		unsigned readUnsigned() {
+			skipSpace();
+			unsigned u = 0;
+			for(; pos < end && isDigit(*pos); ++pos)
+				u = u*10 + static_cast<unsigned>(*pos-'0');
+			return u;
+		}
+
+		int readInt() {
+			skipSpace();
+			bool negative = (peek() == '-');
+			if(negative || peek() == '+') ++pos;
+			int i = static_cast<int>(readUnsigned());
+			return negative ? -i : i;
+		}
+
+		double readDouble();
+	private:
+		static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
+		static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+		void skipSpace() { while(pos < end && isSpace(*pos)) ++pos; }
+
+		const char* pos;
+		const char* end;
+};
+
+/*
+Hand-rolled strtod. If the mantissa fits in 53 bits and the decimal exponent
+is small both it and the power of ten are exact doubles, so one multiply or
+divide gives the correctly rounded answer (Clinger's fast path). Everything
+else (rare in TNTP files) gets copied out and handed to strtod so we never
+disagree with the old istream code.
+*/
+inline double TNTPScanner::readDouble()
+{
+	static const double powersOfTen[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	skipSpace();
+	const char* start = pos;
+	bool negative = false;
+	if(pos < end && (*pos == '-' || *pos == '+')) negative = (*pos++ == '-');
+
+	unsigned long long mantissa = 0;
+	int digits = 0, exponent = 0;
+	for(; pos < end && isDigit(*pos); ++pos, ++digits)
+		mantissa = mantissa*10 + static_cast<unsigned>(*pos-'0');
+	if(pos < end && *pos == '.') {
+		for(++pos; pos < end && isDigit(*pos); ++pos, ++digits, --exponent)
+			mantissa = mantissa*10 + static_cast<unsigned>(*pos-'0');
+	}
+	bool simple = digits <= 15;
+	if(pos < end && (*pos == 'e' || *pos == 'E')) {
+		++pos;
+		bool negativeExponent = false;
+		if(pos < end && (*pos == '-' || *pos == '+')) negativeExponent = (*pos++ == '-');
+		int e = 0;
+		for(; pos < end && isDigit(*pos); ++pos)
+			if(e < 10000) e = e*10 + (*pos-'0');
+		exponent += negativeExponent ? -e : e;
+	}
+	if(simple && exponent >= -22 && exponent <= 22) {
+		double d = static_cast<double>(mantissa);
+		d = exponent < 0 ? d/powersOfTen[-exponent] : d*powersOfTen[exponent];
+		return negative ? -d : d;
+	}
+
+	std::string copy(start, pos);
+	return std::strtod(copy.c_str(), 0);
+}
+
+#endif
@@ -0,0 +1,49 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef VECTOR_KERNELS_HPP
+#define VECTOR_KERNELS_HPP
+
+/*
+Common ground for the hand-vectorised kernels (DistanceKernel, CostBatch,
+FastPow). They're compiled for AVX2 and AVX-512 with target attributes and
+picked at run time, so the rest of the build needn't assume either.
+Building with EF_NO_SIMD leaves them out.
+
+Kernels that do arithmetic have to round exactly like the scalar code they
+stand in for. GCC fuses a*b + c into one FMA in scalar C++ whenever FMA
+is enabled, so EF_MULADD does the same. Nothing else gets fused: the
+kernels are built with contraction off.
+*/
+#if !defined EF_NO_SIMD && defined __GNUC__ && (defined __x86_64__ || defined __i386__)
+ #define EF_X86_KERNELS
+ #include <immintrin.h>
+ 
+ #define EF_KERNEL(isa) __attribute__((target(isa), optimize("fp-contract=off")))
+ #ifdef __FMA__
+  #define EF_MULADD256(a, b, c) _mm256_fmadd_pd(a, b, c)
+  #define EF_MULADD512(a, b, c) _mm512_fmadd_pd(a, b, c)
+ #else
+  #define EF_MULADD256(a, b, c) _mm256_add_pd(_mm256_mul_pd(a, b), c)
+  #define EF_MULADD512(a, b, c) _mm512_add_pd(_mm512_mul_pd(a, b), c)
+ #endif
+#endif
+
+#endif
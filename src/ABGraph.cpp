@@ -20,24 +20,29 @@
 
 #include "ABGraph.hpp"
 #include <iostream>
-#include <queue>
 #include <utility>
-#include <tr1/tuple>
+#include <limits>
 
 using namespace std;
 
-ABGraph::ABGraph(const InputGraph& g) : forwardStructure(g.numNodes()), nodeStorage(g.numNodes()), numberOfEdges(0)
+ABGraph::ABGraph(const InputGraph& g, NodeOrdering ordering) : forwardStructure(g.numNodes()), numberOfEdges(0)
 {
 	unsigned nodes=g.numNodes();
 	
+	orderNodes(g, ordering);
+	
 	vector<EdgeHolder> edgesList;
 
-	//Get a list of real and artificial arcs (sorted, contiguous etc)
+	//Get a list of arcs (sorted, contiguous etc)
 	getEdgeList(edgesList, g);
 
 	//CHAR_BIT/2*sizeof(unsigned) or similar later
 	
 	edgeStructure.reserve(nodes);
+	forwardStorage.reserve(edgesList.size());
+	backwardStorage.reserve(edgesList.size());
+	lengthStorage.reserve(edgesList.size());
+
 	edgeStructure.push_back(0);
 	
 	vector<EdgeHolder>::iterator j = edgesList.begin();
@@ -49,69 +54,303 @@ ABGraph::ABGraph(const InputGraph& g) : forwardStructure(g.numNodes()), nodeStor
 		edgeStructure.push_back(edgesSoFar);
 	}
 	edgeStructure.push_back(edgesSoFar);
+	numberOfEdges = edgesSoFar;
+	internCosts(edgesList);
 	
 	for(unsigned i = 0; i < edgesList.size(); ++i) {
 		EdgeHolder &e = edgesList.at(i);
-		forwardStorage.at(i).setInverse(&backwardStorage.at(edge(e.first, e.second)));
+		unsigned inverse = edge(e.first, e.second);
+		if(inverse == numberOfEdges) {
+			//One-way link.
+			inverse = numberOfEdges + static_cast<unsigned>(reversedLinks.size());
+			reversedLinks.push_back(i);
+			lengthStorage.push_back(numeric_limits<double>::infinity());
+		}
+		forwardStorage.at(i).setInverse(inverse);
+	}
+	listInArcs();
+}
+
+void ABGraph::listInArcs()
+{
+	//Real in-edges are already in from-node order, and so are the edges out
+	//of a node (by to-node), so the reversed one-way links just merge in.
+	inArcStart.reserve(forwardStructure.size()+1);
+	inArcStorage.reserve(lengthStorage.size());
+	for(unsigned n = 0; n < forwardStructure.size(); ++n) {
+		inArcStart.push_back(static_cast<unsigned>(inArcStorage.size()));
+		unsigned j = edgeStructure[n], end = edgeStructure[n+1];
+		vector<unsigned>::const_iterator k = forwardStructure[n].begin(), kEnd = forwardStructure[n].end();
+		while(true) {
+			for(; k != kEnd && !isReversed(forwardStorage[*k].getInverse()); ++k) ;
+			if(k != kEnd && (j == end || forwardStorage[*k].toNode() < backwardStorage[j].fromNode())) {
+				inArcStorage.push_back(make_pair(forwardStorage[*k].getInverse(), forwardStorage[*k].toNode()));
+				++k;
+			} else if(j != end) {
+				inArcStorage.push_back(make_pair(j, backwardStorage[j].fromNode()));
+				++j;
+			} else break;
+		}
 	}
+	inArcStart.push_back(static_cast<unsigned>(inArcStorage.size()));
 }
 
 void ABGraph::getEdgeList(vector<EdgeHolder>& edgesList, const InputGraph &g)
 {
 	typedef vector<EdgeHolder>::iterator vpit;
-	typedef map<unsigned,InputGraph::VDF> EdgeMap;
-	typedef map<unsigned,EdgeMap> GraphMap;
+	typedef vector<InputGraph::Edge>::const_iterator EdgeIt;
 	
-	//Get a list of all edges (real or imagined)
-	for(GraphMap::const_iterator i = g.graph().begin(); i != g.graph().end(); ++i) {
-		unsigned fromNode = i->first;
-		for(EdgeMap::const_iterator j = i->second.begin(); j != i->second.end(); ++j) {
-			unsigned toNode = j->first;
-			edgesList.push_back(EdgeHolder(fromNode, toNode));
-			edgesList.push_back(EdgeHolder(toNode, fromNode, true, j->second));
-		}
+	//Get a list of all edges
+	edgesList.reserve(g.graph().size());
+	for(EdgeIt i = g.graph().begin(); i != g.graph().end(); ++i) {
+		edgesList.push_back(EdgeHolder(internalIds[i->to], internalIds[i->from], i->vdf));
 	}
-	sort(edgesList.begin(), edgesList.end());
+	stable_sort(edgesList.begin(), edgesList.end());
 	
 	//remove duplicates
 	vpit end = unique(edgesList.begin(), edgesList.end());
 	edgesList.erase(end, edgesList.end());
 }
 
-void ABGraph::dijkstra(unsigned origin, vector<long>& distances, vector<unsigned>& order)
+class ABGraph::CostOrder {
+public:
+	CostOrder(const vector<EdgeHolder>& edges) : edges(edges) {}
+	bool operator()(unsigned first, unsigned second) const {
+		return edges[first].func < edges[second].func;
+	}
+private:
+	const vector<EdgeHolder>& edges;
+};
+
+void ABGraph::internCosts(const vector<EdgeHolder>& edgesList)
 {
-	const long unvisited = -1;//Ugly, dumb
+	//Edges i and j share a table entry if their functions are equal. Sort
+	//edge numbers by function to find the groups, then number the entries
+	//in order of first use so neighbouring edges' functions stay close.
+	unsigned edges = static_cast<unsigned>(edgesList.size());
+	vector<unsigned> order(edges);
+	for(unsigned i = 0; i < edges; ++i) order[i] = i;
+	CostOrder byCost(edgesList);
+	stable_sort(order.begin(), order.end(), byCost);
 	
-	priority_queue<tr1::tuple<double, long, long> > queue;
-	queue.push(tr1::make_tuple(0.0, 0, origin));
+	vector<unsigned> firstUse(edges);
+	for(unsigned i = 0; i < edges; ++i) {
+		if(i > 0 && !byCost(order[i-1], order[i])) firstUse[order[i]] = firstUse[order[i-1]];
+		else firstUse[order[i]] = order[i];
+	}
 	
-	while(!queue.empty()) {
-		double distance = tr1::get<0>(queue.top());
-		long id = tr1::get<2>(queue.top());
+	costIndex.reserve(edges);
+	for(unsigned i = 0; i < edges; ++i) {
+		if(firstUse[i] == i) {
+			costIndex.push_back(static_cast<unsigned>(inputCosts.size()));
+			inputCosts.push_back(edgesList[i].func);
+		} else {
+			costIndex.push_back(costIndex[firstUse[i]]);
+		}
+	}
+}
+
+namespace {
+	class DegreeComparator {
+	public:
+		DegreeComparator(const vector<unsigned>& start) : start(start) {}
+		bool operator()(unsigned first, unsigned second) const {
+			return start[first+1]-start[first] < start[second+1]-start[second];
+		}
+	private:
+		const vector<unsigned>& start;
+	};
+}
+
+void ABGraph::orderNodes(const InputGraph &g, NodeOrdering ordering)
+{
+	/*
+	BFS over the graph with arc directions ignored, a component at a time.
+	For reverse Cuthill-McKee each component starts from a lowest-degree
+	node, neighbours are queued lowest degree first, and the whole thing
+	gets reversed at the end. Either way nodes that are close in the
+	network end up close in the label and edge arrays, which is
+	what Dijkstra and buildTrees care about.
+	*/
+	typedef vector<InputGraph::Edge>::const_iterator EdgeIt;
+	unsigned nodes = g.numNodes();
+	
+	inputIds.clear();
+	inputIds.reserve(nodes);
+	if(ordering == INPUT_ORDER) {
+		for(unsigned i = 0; i < nodes; ++i) inputIds.push_back(i);
+	} else {
+		//Undirected adjacency lists, all in one block.
+		vector<unsigned> start(nodes+1, 0);
+		for(EdgeIt i = g.graph().begin(); i != g.graph().end(); ++i) {
+			++start[i->from+1];
+			++start[i->to+1];
+		}
+		for(unsigned i = 0; i < nodes; ++i) start[i+1] += start[i];
+		vector<unsigned> adjacent(start[nodes]);
+		vector<unsigned> filled(start.begin(), start.end()-1);
+		for(EdgeIt i = g.graph().begin(); i != g.graph().end(); ++i) {
+			adjacent[filled[i->from]++] = i->to;
+			adjacent[filled[i->to]++] = i->from;
+		}
 		
-		if(distance == -std::numeric_limits<double>::infinity()) break;
-		//Unnecessary, but saves putting unreachable nodes in the topo sort.
-		//No real time benefit here, but saves a bit in the main algorithm.
+		DegreeComparator byDegree(start);
+		vector<unsigned> seeds(nodes);
+		for(unsigned i = 0; i < nodes; ++i) seeds[i] = i;
+		if(ordering == RCM_ORDER) stable_sort(seeds.begin(), seeds.end(), byDegree);
 		
-		if(distances[id] == unvisited) {//first hit on this node
-			
-			distances[id] = order.size();//final index
-			order.push_back((unsigned)id);//out-topological sort.
-			
-			for(vector<unsigned>::iterator i = forwardStructure[id].begin(); i != forwardStructure[id].end(); ++i) {
-				ForwardGraphEdge& fge = forwardStorage[*i];
-				long toNodeId = fge.toNode()-&nodeStorage[0];
-				if(distances[toNodeId] == unvisited) {
-					//If statement unnecessary, but cuts runtime by 1/3...
-					
-					BackwardGraphEdge& bge = backwardStorage[*i];
-					queue.push(tr1::make_tuple(distance - bge.distance(), -order.size(), toNodeId));
-					
-					//(dist - len) instead of (dist + len) because it's a max-queue (we want the min)
+		vector<bool> visited(nodes, false);
+		for(vector<unsigned>::iterator seed = seeds.begin(); seed != seeds.end(); ++seed) {
+			if(visited[*seed]) continue;
+			visited[*seed] = true;
+			inputIds.push_back(*seed);
+			for(size_t head = inputIds.size()-1; head < inputIds.size(); ++head) {
+				unsigned node = inputIds[head];
+				size_t first = inputIds.size();
+				for(unsigned i = start[node]; i != start[node+1]; ++i) {
+					if(!visited[adjacent[i]]) {
+						visited[adjacent[i]] = true;
+						inputIds.push_back(adjacent[i]);
+					}
 				}
+				if(ordering == RCM_ORDER) stable_sort(inputIds.begin()+first, inputIds.end(), byDegree);
 			}
 		}
+		if(ordering == RCM_ORDER) reverse(inputIds.begin(), inputIds.end());
+	}
+	
+	internalIds.resize(nodes);
+	for(unsigned i = 0; i < nodes; ++i) internalIds[inputIds[i]] = i;
+}
+
+namespace {
+	//Dijkstra's queue entry. Ties on distance go to whichever node got its
+	//distance first (fewest nodes settled at the time), then the higher id.
+	struct HeapEntry {
+		double distance;
+		unsigned round;
+		unsigned id;
+		bool operator<(const HeapEntry& e) const {
+			if(distance != e.distance) return distance < e.distance;
+			if(round != e.round) return round < e.round;
+			return id > e.id;
+		}
+	};
+	
+	/*
+	Indexed 4-ary heap: each node is in it at most once, and gets its key
+	lowered rather than being pushed again. Positions live in the caller's
+	distance map as -2-position, so there's nothing per-node to allocate;
+	-1 is unvisited and anything >= 0 is settled.
+	*/
+	class DijkstraHeap {
+	public:
+		DijkstraHeap(vector<long>& state) : state(state) {}
+		bool empty() const { return heap.empty(); }
+		const HeapEntry& top() const { return heap.front(); }
+		void pop() {
+			HeapEntry last = heap.back();
+			heap.pop_back();
+			if(!heap.empty()) siftDown(0, last);
+		}
+		//Adds the node, or lowers its key if it's already in and e is closer.
+		void push(const HeapEntry& e) {
+			long s = state[e.id];
+			if(s == -1) {
+				heap.push_back(e);
+				siftUp(heap.size()-1, e);
+			} else {
+				size_t position = static_cast<size_t>(-2-s);
+				if(e.distance < heap[position].distance) siftUp(position, e);
+			}
+		}
+	private:
+		void place(size_t position, const HeapEntry& e) {
+			heap[position] = e;
+			state[e.id] = -2-static_cast<long>(position);
+		}
+		void siftUp(size_t position, const HeapEntry& e) {
+			while(position > 0) {
+				size_t parent = (position-1)/4;
+				if(!(e < heap[parent])) break;
+				place(position, heap[parent]);
+				position = parent;
+			}
+			place(position, e);
+		}
+		void siftDown(size_t position, const HeapEntry& e) {
+			size_t size = heap.size();
+			while(true) {
+				size_t child = 4*position+1;
+				if(child >= size) break;
+				size_t best = child;
+				size_t last = min(child+4, size);
+				for(++child; child < last; ++child)
+					if(heap[child] < heap[best]) best = child;
+				if(!(heap[best] < e)) break;
+				place(position, heap[best]);
+				position = best;
+			}
+			place(position, e);
+		}
+		vector<HeapEntry> heap;
+		vector<long>& state;
+	};
+}
+
+void ABGraph::dijkstra(unsigned origin, vector<long>& distances, vector<unsigned>& order, const vector<pair<int, double> >* destinations)
+{
+	const double infinity = numeric_limits<double>::infinity();
+	
+	//Destinations not settled yet, when we're stopping early.
+	vector<bool> waiting;
+	size_t waitingFor = 0;
+	if(destinations) {
+		waiting.resize(distances.size(), false);
+		for(vector<pair<int, double> >::const_iterator i = destinations->begin(); i != destinations->end(); ++i) {
+			if(!waiting[i->first]) ++waitingFor;
+			waiting[i->first] = true;
+		}
+	}
+	
+	DijkstraHeap queue(distances);
+	HeapEntry start = { 0.0, 0, origin };
+	queue.push(start);
+	
+	while(!queue.empty()) {
+		HeapEntry top = queue.top();
 		queue.pop();
 		
+		distances[top.id] = order.size();//final index
+		order.push_back(top.id);//out-topological sort.
+		if(destinations && waiting[top.id] && --waitingFor == 0) break;
+		
+		for(vector<unsigned>::iterator i = forwardStructure[top.id].begin(); i != forwardStructure[top.id].end(); ++i) {
+			unsigned toNodeId = forwardStorage[*i].toNode();
+			if(distances[toNodeId] < 0) {
+				HeapEntry e = { top.distance + lengthStorage[*i], static_cast<unsigned>(order.size()), toNodeId };
+				if(e.distance != infinity) queue.push(e);
+				//Saves putting unreachable nodes in the topo sort.
+			}
+		}
+	}
+	
+	if(destinations && waitingFor == 0) {
+		/*
+		Every destination's settled, so the rest only has to be in some
+		topological order. Anything still reachable goes on the end
+		breadth-first, so each of them has an in-arc from earlier on and
+		the bush can start using it later.
+		*/
+		for(size_t j = 0; j < order.size(); ++j) {
+			unsigned id = order[j];
+			for(vector<unsigned>::iterator i = forwardStructure[id].begin(); i != forwardStructure[id].end(); ++i) {
+				unsigned toNodeId = forwardStorage[*i].toNode();
+				if(distances[toNodeId] < 0 && lengthStorage[*i] != infinity) {
+					distances[toNodeId] = order.size();
+					order.push_back(toNodeId);
+				}
+			}
+		}
 	}
 }
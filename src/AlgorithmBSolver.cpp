@@ -19,27 +19,27 @@
 
 
 #include "AlgorithmBSolver.hpp"
+#include "IntegerBPR.hpp"
 
 #include <memory>
 #include <algorithm> //For max
+#include <iterator>
 #include <iostream>
-#include <map>
 
 using namespace std;
 
 class BushEdge;
 
-AlgorithmBSolver::AlgorithmBSolver(const InputGraph& g): graph(g), tempStore(graph.nodes().size()), reverseTS(g.numNodes())
+template<typename Cost>
+AlgorithmBSolver<Cost>::AlgorithmBSolver(const InputGraph& g, ABGraph::NodeOrdering ordering, bool stopAtDestinations, unsigned batchSize, unsigned threads): graph(g, ordering), scratch(max(threads, 1u), BushScratch(g.numNodes())), workers(max(threads, 1u))
 {
 	//NOTE: A little heavy work in the graph ctor in the init list.
 	//Read ODData out of graph
-	for(map<unsigned,map<unsigned, double> >::const_iterator i = g.demand().begin(); i != g.demand().end(); ++i) {
-		unsigned index = i->first;
-		Origin o(index);
-		ODData.push_back(o);
-		for(map<unsigned,double>::const_iterator j = i->second.begin(); j != i->second.end(); ++j) {
-			ODData.back().addDestination(j->first, j->second);
-		}
+	//Demand comes sorted by origin, so each origin's destinations are contiguous.
+	for(vector<InputGraph::Demand>::const_iterator i = g.demand().begin(); i != g.demand().end(); ++i) {
+		if(ODData.empty() || ODData.back().getOrigin() != static_cast<int>(i->from))
+			ODData.push_back(Origin(i->from));
+		ODData.back().addDestination(i->to, i->amount);
 	}
 	
 /*	for(unsigned i = 0; i < num_vertices(*g); ++i) {
@@ -51,45 +51,271 @@ AlgorithmBSolver::AlgorithmBSolver(const InputGraph& g): graph(g), tempStore(gra
 				ODData.back().addDestination(j->first, j->second);
 		}
 	}*/
-	//Set up a bush for every origin. Most of the work is in here - Dijkstra over the graph in the Bush ctor.
-	for(list<Origin>::iterator i = ODData.begin(); i != ODData.end(); ++i) {
-		bushes.push_back(new Bush(*i, graph, tempStore, reverseTS));
+	//Set up a bush for every origin. Most of the work is in here - Dijkstra over the graph for each.
+	vector<ShortestPathTree> trees(max(batchSize, 1u));
+	for(list<Origin>::iterator i = ODData.begin(); i != ODData.end();) {
+		list<Origin>::iterator first = i;
+		for(size_t n = 0; n < trees.size() && i != ODData.end(); ++n, ++i)
+			i->renumber(graph.nodeNumbering());
+		buildBushes(first, i, trees, stopAtDestinations);
+	}
+}
+
+template<typename Cost>
+AlgorithmBSolver<Cost>::AlgorithmBSolver(const InputGraph& g, OriginQueue& origins, ABGraph::NodeOrdering ordering, bool stopAtDestinations, unsigned batchSize, unsigned threads): graph(g, ordering), scratch(max(threads, 1u), BushScratch(g.numNodes())), workers(max(threads, 1u))
+{
+	//Same as above, but each batch of bushes gets going while the parser is
+	//still working on later Origin blocks.
+	vector<ShortestPathTree> trees(max(batchSize, 1u));
+	for(bool more = true; more;) {
+		list<Origin>::iterator first = ODData.end();
+		for(size_t n = 0; n < trees.size() && (more = origins.pop(ODData)); ++n) {
+			ODData.back().renumber(graph.nodeNumbering());
+			if(n == 0) first = --ODData.end();
+		}
+		buildBushes(first, ODData.end(), trees, stopAtDestinations);
+	}
+}
+
+template<typename Cost>
+void AlgorithmBSolver<Cost>::buildBushes(list<Origin>::iterator first, list<Origin>::iterator end, vector<ShortestPathTree>& trees, bool stopAtDestinations)
+{
+	/*
+	Cut the batch into a run of origins per scratch area (so per thread).
+	Nothing touches the link flows while the bushes are being built; with
+	more than one origin to a batch they hold on to their initial flows,
+	and those go onto the links here afterwards, in origin order.
+	*/
+	graph.refreshLengths();
+	size_t count = static_cast<size_t>(distance(first, end));
+	size_t pieces = min(scratch.size(), count);
+	vector<Bush<Cost>*> built(count);
+	vector<BushBuilder> builders(pieces);
+	for(size_t p = 0; p < pieces; ++p) {
+		size_t from = count*p/pieces, to = count*(p+1)/pieces;
+		BushBuilder& b = builders[p];
+		b.graph = &graph;
+		b.first = first;
+		advance(first, static_cast<long>(to-from));
+		b.end = first;
+		b.trees = &trees[from];
+		b.built = &built[from];
+		b.scratch = &scratch[p];
+		b.stopAtDestinations = stopAtDestinations;
+		b.loadGraph = trees.size() == 1;
+	}
+	
+	workers.run(builders, pieces);
+	
+	for(typename vector<Bush<Cost>*>::iterator i = built.begin(); i != built.end(); ++i) {
+		if(trees.size() != 1) (*i)->loadInitialFlows();
+		(*i)->setWorkspace(graph, scratch[0]);
+		bushes.push_back(*i);
 	}
 }
 
-bool AlgorithmBSolver::fixBushSets(list<Bush*>& fix, list<Bush*>& output, double average, bool whetherMove)
+template<typename Cost>
+void AlgorithmBSolver<Cost>::BushBuilder::operator()()
+{
+	for(list<Origin>::iterator i = first; i != end; ++i, ++trees, ++built) {
+		graph->dijkstra(i->getOrigin(), *trees, stopAtDestinations ? &i->dests() : 0);
+		*built = new Bush<Cost>(*i, *graph, *scratch, *trees, loadGraph);
+	}
+}
+
+template<typename Cost>
+bool AlgorithmBSolver<Cost>::fixBushSets(list<Bush<Cost>*>& fix, list<Bush<Cost>*>& output, double average, bool whetherMove, unsigned roundSize)
 {
 	//TODO: Replace with std::partition and list.splice when we get lambdas (C++0x).
-	vector<list<Bush*>::iterator> move;
-	for(list<Bush*>::iterator i = fix.begin(); i != fix.end(); ++i) {
-		if((*i)->fix(average) == whetherMove) move.push_back(i);
+	typedef typename list<Bush<Cost>*>::iterator BushIterator;
+	vector<BushIterator> move;
+	if(roundSize > 1) {
+		vector<BushIterator> round;
+		vector<Bush<Cost>*> roundBushes;
+		vector<char> fixed;
+		for(BushIterator i = fix.begin(); i != fix.end();) {
+			round.clear();
+			roundBushes.clear();
+			for(; i != fix.end() && round.size() < roundSize; ++i) {
+				round.push_back(i);
+				roundBushes.push_back(*i);
+			}
+			fixRound(roundBushes, fixed, average);
+			for(size_t b = 0; b < round.size(); ++b)
+				if((fixed[b] != 0) == whetherMove) move.push_back(round[b]);
+		}
+	} else {
+		copies.clear();//They only follow changes made in rounds.
+		for(BushIterator i = fix.begin(); i != fix.end(); ++i) {
+			if((*i)->fix(average) == whetherMove) move.push_back(i);
+		}
 	}
-	for(vector<list<Bush*>::iterator>::iterator i = move.begin(); i != move.end(); ++i) {
+	for(typename vector<BushIterator>::iterator i = move.begin(); i != move.end(); ++i) {
 		output.push_back(**i);
 		fix.erase(*i);
 	}//promote
 	return output.empty();
 }
 
-void AlgorithmBSolver::solve(unsigned iterationLimit)
+template<typename Cost>
+void AlgorithmBSolver<Cost>::fixRound(vector<Bush<Cost>*>& round, vector<char>& fixed, double average)
 {
-	//TODO: Change this to something better than .25*avg (probably nth_element)
+	/*
+	Every bush in the round starts from the links as they are, and
+	nothing touches them until all the round's bushes are equilibriated.
+	None of the bushes has seen what the others did, so together they can
+	overshoot (badly, near equilibrium, when they all want the same
+	links). Their changes go onto the links one bush at a time, in round
+	order, and only if they still lower the objective by then; the rest
+	go back to how they were and try again next time. The first one saw
+	the links as they really are, so that's never all of them.
+	Threads get a contiguous run of the round each, and their copy of the
+	links is back to the real ones before every bush, so which thread does
+	a bush makes no difference to it: with the commits in round order, the
+	answer is the same for any number of threads.
+	Copying all the links for every bush would cost more than fixing most
+	bushes does, so the copies keep track of which links a bush changed
+	and only put those back, and pick up the links the commits changed
+	before the next round.
+	*/
+	graph.refreshLengths();
+	size_t count = round.size(), pieces = min(scratch.size(), count);
+	while(copies.size() < pieces)
+		copies.push_back(graph);
+	if(fixers.size() < pieces) fixers.resize(pieces);
+	fixed.assign(count, 0);
+	for(size_t p = 0; p < pieces; ++p) {
+		size_t from = count*p/pieces, to = count*(p+1)/pieces;
+		BushFixer& f = fixers[p];
+		f.graph = &graph;
+		f.copy = &copies[p];
+		f.scratch = &scratch[p];
+		f.home = &scratch[0];
+		f.first = &round[0] + from;
+		f.end = &round[0] + to;
+		f.fixed = &fixed[from];
+		f.average = average;
+		f.equilibriating = true;
+		f.before.resize(to-from);
+		f.moved = &moved;
+	}
+	workers.run(fixers, pieces);
 	
+	vector<pair<unsigned, double> > changes;
+	vector<double> lengths;
+	moved.clear();
+	graph.track(&moved);
+	for(size_t p = 0; p < pieces; ++p) {
+		BushFixer& f = fixers[p];
+		for(size_t b = 0; f.first + b != f.end; ++b) {
+			f.first[b]->flowChanges(f.before[b], changes);
+			//Trapezoidal estimate of the change in the objective.
+			double change = 0.0;
+			lengths.resize(changes.size());
+			for(size_t i = 0; i < changes.size(); ++i) {
+				unsigned e = changes[i].first;
+				lengths[i] = (*graph.costFunction(e))(graph.forwardEdge(e).getFlow() + changes[i].second);
+				change += changes[i].second*(graph.length(e)+lengths[i]);
+			}
+			if(change < 0) {
+				for(size_t i = 0; i < changes.size(); ++i)
+					graph.addFlow(changes[i].first, changes[i].second, lengths[i]);
+			} else {
+				f.first[b]->restoreFlows(f.before[b]);
+			}
+		}
+		f.equilibriating = false;
+	}
+	graph.track(0);
+	//Copies this round didn't need still have to keep up.
+	for(size_t p = pieces; p < copies.size(); ++p)
+		for(vector<unsigned>::const_iterator e = moved.begin(); e != moved.end(); ++e)
+			copies[p].copyFlow(graph, *e);
+	workers.run(fixers, pieces);
+}
+
+template<typename Cost>
+void AlgorithmBSolver<Cost>::BushFixer::operator()()
+{
+	if(!equilibriating) {
+		for(vector<unsigned>::const_iterator e = moved->begin(); e != moved->end(); ++e)
+			copy->copyFlow(*graph, *e);
+	}
+	vector<vector<double> >::iterator saved = before.begin();
+	for(Bush<Cost>** i = first; i != end; ++i, ++saved) {
+		Bush<Cost>& bush = **i;
+		if(equilibriating) {
+			bush.setWorkspace(*copy, *scratch);
+			bush.saveFlows(*saved);
+			changed.clear();
+			copy->track(&changed);
+			fixed[i-first] = bush.equilibriate(average);
+			copy->track(0);
+			for(vector<unsigned>::const_iterator e = changed.begin(); e != changed.end(); ++e)
+				copy->copyFlow(*graph, *e);
+		} else {
+			bush.setWorkspace(*graph, *scratch);
+			bush.fixEdges();
+			bush.setWorkspace(*graph, *home);
+		}
+	}
+}
+
+template<typename Cost>
+double AlgorithmBSolver<Cost>::sumOverBushes(double (Bush<Cost>::*measure)())
+{
+	//Works out each bush's value on whichever thread, but adds them up
+	//here in list order, so the sum is the same as one thread's.
+	graph.refreshLengths();
+	vector<Bush<Cost>*> all(bushes.begin(), bushes.end());
+	all.insert(all.end(), lazyBushes.begin(), lazyBushes.end());
+	vector<double> values(all.size());
+	size_t count = all.size(), pieces = min(scratch.size(), count);
+	vector<BushMeasurer> measurers(pieces);
+	for(size_t p = 0; p < pieces; ++p) {
+		size_t from = count*p/pieces, to = count*(p+1)/pieces;
+		BushMeasurer& m = measurers[p];
+		m.graph = &graph;
+		m.scratch = &scratch[p];
+		m.home = &scratch[0];
+		m.first = &all[0] + from;
+		m.end = &all[0] + to;
+		m.measure = measure;
+		m.values = &values[from];
+	}
+	workers.run(measurers, pieces);
 	
 	double sum = 0.0;
-	for(list<Bush*>::iterator i = bushes.begin(); i != bushes.end(); ++i) 
-		sum += (*i)->maxDifference();
-	for(list<Bush*>::iterator i = lazyBushes.begin(); i != lazyBushes.end(); ++i)
-		sum += (*i)->maxDifference();
+	for(vector<double>::const_iterator i = values.begin(); i != values.end(); ++i)
+		sum += *i;
+	return sum;
+}
 
+template<typename Cost>
+void AlgorithmBSolver<Cost>::BushMeasurer::operator()()
+{
+	for(Bush<Cost>** i = first; i != end; ++i, ++values) {
+		(*i)->setWorkspace(*graph, *scratch);
+		*values = ((*i)->*measure)();
+		(*i)->setWorkspace(*graph, *home);
+	}
+}
+
+template<typename Cost>
+unsigned AlgorithmBSolver<Cost>::solve(unsigned iterationLimit, unsigned roundSize)
+{
+	//TODO: Change this to something better than .25*avg (probably nth_element)
+	double sum = sumOverBushes(&Bush<Cost>::maxDifference);
 	double average= 0.25*sum / ((double)(bushes.size() + lazyBushes.size()));
 	
-	for(unsigned iteration = 0; iteration < iterationLimit; ++iteration) {
+	unsigned iteration;
+	for(iteration = 0; iteration < iterationLimit; ++iteration) {
 		if(iteration % 4 == 3) {
-			if(fixBushSets(lazyBushes, bushes, average, true)) return;
+			if(fixBushSets(lazyBushes, bushes, average, true, roundSize)) return iteration;
 		}
-		fixBushSets(bushes, lazyBushes, average, false);
+		fixBushSets(bushes, lazyBushes, average, false, roundSize);
 	}
+	return iteration;
 }
 
 /*void AlgorithmBSolver::outputAnswer(shared_ptr<InputGraph> inGraph) const
@@ -111,25 +337,21 @@ void AlgorithmBSolver::solve(unsigned iterationLimit)
 	}
 }*/
 
-double AlgorithmBSolver::relativeGap()
+template<typename Cost>
+double AlgorithmBSolver<Cost>::relativeGap()
 {
+	graph.refreshLengths();
 	double upperBound = graph.currentCost();
-	double lowerBound = 0.0;
-	for(list<Bush*>::iterator i = bushes.begin(); i != bushes.end(); ++i)
-		lowerBound += (*i)->allOrNothingCost();
-	for(list<Bush*>::iterator i = lazyBushes.begin(); i != lazyBushes.end(); ++i)
-		lowerBound += (*i)->allOrNothingCost();
+	double lowerBound = sumOverBushes(&Bush<Cost>::allOrNothingCost);
 	return 1-lowerBound/upperBound;
 }
 
-double AlgorithmBSolver::averageExcessCost()
+template<typename Cost>
+double AlgorithmBSolver<Cost>::averageExcessCost()
 {
+	graph.refreshLengths();
 	double upperBound = graph.currentCost();
-	double lowerBound = 0.0;
-	for(list<Bush*>::iterator i = bushes.begin(); i != bushes.end(); ++i)
-		lowerBound += (*i)->allOrNothingCost();
-	for(list<Bush*>::iterator i = lazyBushes.begin(); i != lazyBushes.end(); ++i)
-		lowerBound += (*i)->allOrNothingCost();
+	double lowerBound = sumOverBushes(&Bush<Cost>::allOrNothingCost);
 	double demand = 0;
 	for(list<Origin>::iterator i = ODData.begin(); i != ODData.end(); ++i) {
 		for(vector<pair<int,double> >::const_iterator j = i->dests().begin(); j != i->dests().end(); ++j) {
@@ -138,10 +360,14 @@ double AlgorithmBSolver::averageExcessCost()
 	}
 	return (upperBound-lowerBound)/demand;
 }
-AlgorithmBSolver::~AlgorithmBSolver()
+template<typename Cost>
+AlgorithmBSolver<Cost>::~AlgorithmBSolver()
 {
-	for(list<Bush*>::const_iterator i = bushes.begin(); i != bushes.end(); ++i)
+	for(typename list<Bush<Cost>*>::const_iterator i = bushes.begin(); i != bushes.end(); ++i)
 		delete *i;
-	for(list<Bush*>::const_iterator i = lazyBushes.begin(); i != lazyBushes.end(); ++i)
+	for(typename list<Bush<Cost>*>::const_iterator i = lazyBushes.begin(); i != lazyBushes.end(); ++i)
 		delete *i;
 }
+
+template class AlgorithmBSolver<CostFunction>;
+template class AlgorithmBSolver<IntegerBPR<4> >;
@@ -18,12 +18,17 @@ License along with EF.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "BarGeraImporter.hpp"
-#include "BarGeraBPRFunction.hpp"
+#include "CostFunction.hpp"
+#include "DecompressingReader.hpp"
 #include "InputGraph.hpp"
+#include "MappedFile.hpp"
+#include "TNTPScanner.hpp"
 
-#include <limits>
 #include <vector>
-#include <cctype>//isspace()
+#include <limits>
+#include <algorithm>
+#include <string>
+#include <iterator>
 
 using namespace std;
 
@@ -31,14 +36,42 @@ void BarGeraImporter::readInGraph(InputGraph& graph, std::istream& networkStream
 {
 	if(!networkStream) throw "Network file does not exist";
 	if(!tripsStream) throw "Trips file does not exist";
-	readInNetwork(graph, networkStream);
-	readInTrips(graph, tripsStream);
+	string network((istreambuf_iterator<char>(networkStream)), istreambuf_iterator<char>());
+	string trips((istreambuf_iterator<char>(tripsStream)), istreambuf_iterator<char>());
+	bytes += network.size() + trips.size();
+	readInNetwork(graph, network.data(), network.data()+network.size());
+	readInTrips(graph, trips.data(), trips.data()+trips.size());
+	graph.finalise();
+}
+
+void BarGeraImporter::readInGraph(InputGraph& graph, const char* networkFile, const char* tripsFile)
+{
+	MappedFile network(networkFile);
+	MappedFile trips(tripsFile);
+	bytes += network.size() + trips.size();
+	readInNetwork(graph, network.begin(), network.end());
+	readInTrips(graph, trips.begin(), trips.end());
+	graph.finalise();
 }
 
-void BarGeraImporter::readInNetwork(InputGraph& graph, std::istream& is)
+void BarGeraImporter::readInGraph(InputGraph& graph, const char* networkFile, const char* tripsFile, const char* cacheFile)
+{
+	NetworkCache cache(cacheFile, networkFile, tripsFile, distanceCost, tollCost);
+	if(cache.load(graph, powError)) {
+		bytes += cache.size();
+		return;
+	}
+	vector<NetworkCache::Link> links;
+	linkRecord = &links;
+	readInGraph(graph, networkFile, tripsFile);
+	linkRecord = 0;
+	cache.save(graph, links);
+}
+
+bool BarGeraImporter::readNetworkMetadata(TNTPScanner& s, unsigned& arcs)
 {
 	/*
-	TODO: format is:
+	Format is (in any order, possibly with other tags and comments mixed in):
 	
 	<NUMBER OF ZONES> Z
 	<NUMBER OF NODES> N
@@ -46,123 +79,300 @@ void BarGeraImporter::readInNetwork(InputGraph& graph, std::istream& is)
 	<NUMBER OF LINKS> E
 	<END OF METADATA>
 	
-	We should also deal with comments properly.
+	Zones are worked out from F, not Z - we care about where the
+	non-through nodes stop.
 	*/
-	skipComments(is);
-	is.ignore(numeric_limits<streamsize>::max(),'\n');//Skip #zones - not important
+	string tag;
+	while(!s.atEnd()) {
+		if(!s.readTag(tag)) {
+			s.skipLine();//Junk before a tag. Old importer skipped it too.
+			continue;
+		}
+		if(tag == "END OF METADATA") return true;
+		else if(tag == "NUMBER OF NODES") nodes = s.readUnsigned();
+		else if(tag == "FIRST THRU NODE") zones = s.readUnsigned() - 1;
+		else if(tag == "NUMBER OF LINKS") arcs = s.readUnsigned();
+		s.skipLine();//Sometimes there is misc metadata. Ugh. Skip that stuff.
+	}
+	return false;
+}
+
+bool BarGeraImporter::readTripsMetadata(TNTPScanner& s)
+{
+	//Only <END OF METADATA> matters, we get the zones from the network file.
+	string tag;
+	while(!s.atEnd()) {
+		if(s.readTag(tag) && tag == "END OF METADATA") return true;
+		s.skipLine();
+	}
+	return false;
+}
+
+void BarGeraImporter::readInNetwork(InputGraph& graph, const char* begin, const char* end)
+{
+	DecompressingReader reader(begin, end);
+	unsigned arcs = numeric_limits<unsigned>::max();//Read to the end if we aren't told.
+	nodes = zones = 0;
+	bool metadata = false;
+	while(reader.next(begin, end)) {
+		TNTPScanner s(begin, end);
+		if(!metadata) {
+			if(!(metadata = readNetworkMetadata(s, arcs))) continue;
+			graph.setNodes(nodes+zones);
+			if(arcs != numeric_limits<unsigned>::max()) graph.reserve(arcs, 0);
+		}
+		addLinks(graph, s.position(), end, arcs);
+	}
+	if(!metadata) graph.setNodes(nodes+zones);
+}
+
+void BarGeraImporter::readInTrips(InputGraph& graph, const char* begin, const char* end)
+{
+	DecompressingReader reader(begin, end);
+	bool metadata = false;
+	int currentNode = -1;
+	while(reader.next(begin, end)) {
+		TNTPScanner s(begin, end);
+		if(!metadata && !(metadata = readTripsMetadata(s))) continue;
+		currentNode = addDemand(graph, s.position(), end, currentNode);
+	}
+}
+
+void BarGeraImporter::addLinks(InputGraph& graph, const char* begin, const char* end, unsigned& arcs)
+{
+	//Rows are independent, so we can cut the file anywhere a row ends.
+	vector<const char*> cuts;
+	splitChunks(begin, end, cuts, ';');
+	vector<NetworkChunk> chunks;
+	for(unsigned i = 0; i+1 < cuts.size(); ++i)
+		chunks.push_back(NetworkChunk(cuts[i], cuts[i+1], nodes, zones));
+	runChunks(chunks);
 	
-	skipComments(is);
-	is.ignore(numeric_limits<streamsize>::max(),'>');//Skip to #nodes
-	is >> nodes;//Read in #nodes
-	skipComments(is);
-	is.ignore(numeric_limits<streamsize>::max(),'>');//Skip to First Through Node
-	unsigned firstThroughNode;
-	is >> firstThroughNode;
-	zones = firstThroughNode - 1;
-	graph.setNodes(nodes+zones);
-	skipComments(is);
-	is.ignore(numeric_limits<streamsize>::max(),'>');//Skip to #edges
-	unsigned arcs;
-	is >> arcs;
+	//Merge in file order, so the result doesn't depend on the thread count.
+	for(vector<NetworkChunk>::iterator c = chunks.begin(); c != chunks.end(); ++c) {
+		for(vector<NetworkChunk::Row>::iterator r = c->rows.begin(); r != c->rows.end() && arcs > 0; ++r, --arcs) {
+			double extraCost = r->length*distanceCost+r->toll*tollCost;
+			graph.addEdge(r->from, r->to, CostFunction(r->zeroFlowTime, r->capacity, r->alpha, r->beta, extraCost, powError));
+			if(linkRecord) {
+				NetworkCache::Link l = {r->from, r->to, r->zeroFlowTime, r->capacity, r->alpha, r->beta, extraCost};
+				linkRecord->push_back(l);
+			}
+		}
+		vector<NetworkChunk::Row>().swap(c->rows);
+	}
+}
+
+int BarGeraImporter::addDemand(InputGraph& graph, const char* begin, const char* end, int currentNode)
+{
+	//Only cut where an Origin block starts: destinations belong to the last origin seen.
+	vector<const char*> cuts;
+	splitChunks(begin, end, cuts, 'O');
+	vector<TripsChunk> chunks;
+	for(unsigned i = 0; i+1 < cuts.size(); ++i)
+		chunks.push_back(TripsChunk(cuts[i], cuts[i+1], nodes, zones, 0, i == 0 ? currentNode : -1));
+	runChunks(chunks);
 	
-	endMetadata(is);
+	std::size_t pairs = 0;
+	for(vector<TripsChunk>::iterator c = chunks.begin(); c != chunks.end(); ++c)
+		pairs += c->demand.size();
+	graph.reserve(0, pairs);
+	for(vector<TripsChunk>::iterator c = chunks.begin(); c != chunks.end(); ++c) {
+		for(vector<InputGraph::Demand>::iterator d = c->demand.begin(); d != c->demand.end(); ++d)
+			graph.addDemand(d->from, d->to, d->amount);
+		vector<InputGraph::Demand>().swap(c->demand);
+	}
+	return chunks.empty() ? currentNode : chunks.back().currentNode;
+}
+
+void BarGeraImporter::readInNetwork(InputGraph& graph, const char* networkFile)
+{
+	MappedFile network(networkFile);
+	bytes += network.size();
+	readInNetwork(graph, network.begin(), network.end());
+	graph.finalise();
+}
+
+void BarGeraImporter::readInTrips(const char* tripsFile, OriginQueue& origins)
+{
+	try {
+		MappedFile trips(tripsFile);
+		DecompressingReader reader(trips.begin(), trips.end());
+		TripsChunk chunk(0, 0, nodes, zones, &origins);
+		bool metadata = false;
+		const char* begin;
+		const char* end;
+		while(reader.next(begin, end)) {
+			TNTPScanner s(begin, end);
+			if(!metadata && !(metadata = readTripsMetadata(s))) continue;
+			streamDemand(chunk, s.position(), end, origins);
+		}
+		chunk.finish();
+		bytes += trips.size();
+	} catch(...) {
+		origins.close();//Don't leave the solver waiting forever.
+		throw;
+	}
+	origins.close();
+}
+
+void BarGeraImporter::streamDemand(TripsChunk& chunk, const char* begin, const char* end, OriginQueue& origins) const
+{
+	/*
+	Like addDemand, but the origins have to reach the queue in file order.
+	The first piece streams straight onto the queue from this thread, so
+	the solver can get started; the others are parsed into queues of their
+	own meanwhile and handed over in turn. chunk carries the origin we're
+	part way through from one block to the next, and the last piece's
+	unfinished origin goes back into it.
+	*/
+	vector<const char*> cuts;
+	splitChunks(begin, end, cuts, 'O');
+	size_t pieces = cuts.size()-1;
+	vector<OriginQueue> parsed(pieces);
+	vector<TripsChunk> chunks;
+	for(size_t i = 1; i < pieces; ++i)
+		chunks.push_back(TripsChunk(cuts[i], cuts[i+1], nodes, zones, &parsed[i]));
+	vector<MThread> workers(pieces);
+	for(size_t i = 1; i < pieces; ++i)
+		workers[i].start(chunks[i-1]);
 	
-	while (arcs --> 0) {
-		skipComments(is);
-		unsigned to, from;
-		is >> from >> to;
-		
-		if(to <= zones) to += nodes;
+	chunk.begin = cuts[0];
+	chunk.end = cuts[1];
+	chunk();
+	//Every piece but the first starts at an Origin, so the origin each
+	//one before it ended on is done.
+	if(pieces > 1) chunk.finish();
+	for(size_t i = 1; i < pieces; ++i) {
+		workers[i].join();
+		TripsChunk& c = chunks[i-1];
+		if(i+1 < pieces) {
+			c.finish();
+		} else {
+			chunk.currentNode = c.currentNode;
+			chunk.demand.swap(c.demand);
+		}
+		origins.append(parsed[i]);
+	}
+}
+
+void BarGeraImporter::splitChunks(const char* begin, const char* end, vector<const char*>& cuts, char boundary) const
+{
+	/*
+	Cut [begin, end) into roughly equal pieces, one per thread, but never
+	into pieces smaller than minimumChunk - threads aren't free.
+	Boundaries always land at the start of a line. For ';' we cut after
+	the first line that ends a row, for 'O' before the first line that
+	starts with an Origin keyword.
+	*/
+	std::size_t length = static_cast<std::size_t>(end-begin);
+	std::size_t pieces = min<std::size_t>(threads, length/minimumChunk);
+	cuts.push_back(begin);
+	for(std::size_t i = 1; i < pieces; ++i) {
+		TNTPScanner s(max(begin + length*i/pieces, cuts.back()), end);
+		if(boundary == ';') {
+			s.skipPast(';');
+			s.skipLine();
+		} else {
+			s.skipLine();
+			while(!s.atEnd()) {
+				const char* lineStart = s.position();
+				while(s.peek() == ' ' || s.peek() == '\t') s.skipPast(s.peek());
+				if(s.peek() == boundary) {
+					s = TNTPScanner(lineStart, end);
+					break;
+				}
+				s.skipLine();
+			}
+		}
+		if(s.position() > cuts.back() && s.position() < end) cuts.push_back(s.position());
+	}
+	cuts.push_back(end);
+}
+
+template<typename Chunk>
+void BarGeraImporter::runChunks(vector<Chunk>& chunks) const
+{
+	vector<MThread> workers(chunks.size());
+	for(unsigned i = 1; i < chunks.size(); ++i)
+		workers[i].start(chunks[i]);
+	if(!chunks.empty()) chunks[0]();//Might as well do some work ourselves.
+	for(unsigned i = 1; i < chunks.size(); ++i)
+		workers[i].join();
+}
+
+void BarGeraImporter::NetworkChunk::operator()()
+{
+	TNTPScanner s(begin, end);
+	while(true) {
+		s.skipComments();
+		if(s.atEnd()) break;
+		Row r;
+		r.from = s.readUnsigned();
+		r.to = s.readUnsigned();
 		
-		double capacity, length, speed, toll, zeroFlowTime, alpha;
-		double beta;
+		if(r.to <= zones) r.to += nodes;
+		--r.from;
+		--r.to;
 		
-		is >> capacity >> length >> zeroFlowTime >> alpha >> beta >> speed >> toll;
-		//Don't use speed, type?
-		BarGeraBPRFunction func(zeroFlowTime, capacity, alpha, beta, length*distanceCost+toll*tollCost);
-		graph.addEdge(from-1, to-1, func.costFunction());
+		r.capacity = s.readDouble();
+		r.length = s.readDouble();
+		r.zeroFlowTime = s.readDouble();
+		r.alpha = s.readDouble();
+		r.beta = s.readDouble();
+		s.readDouble();//Don't use speed, type?
+		r.toll = s.readDouble();
+		rows.push_back(r);
 		
-		is.ignore(numeric_limits<streamsize>::max(),';');//Skip to end of row
+		s.skipPast(';');//Skip to end of row
 	}
 }
 
-void BarGeraImporter::readInTrips(InputGraph& graph, std::istream& is)
+void BarGeraImporter::TripsChunk::operator()()
 {
-	skipComments(is);
-	is.ignore(numeric_limits<streamsize>::max(),'>');//Skip to #zones
-	unsigned z;
-	is >> z;
-	
-	skipComments(is);
-	is.ignore(numeric_limits<streamsize>::max(),'\n');//Skip next line
-	skipComments(is);
-	endMetadata(is);
-	
-	int currentNode = -1;
-	vector<pair<unsigned, double> > currentDestinations;
+	TNTPScanner s(begin, end);
 	while(true) {
-		skipComments(is);
-		if(!is.good()) break;
-		if(is.peek() == 'O') {
-			is.ignore(6);
-			//New origin. Add the old one to the graph if it has destinations.
-			if (!currentDestinations.empty()) {
-				for(vector<pair<unsigned,double> >::iterator i = currentDestinations.begin(); i != currentDestinations.end(); ++i)
-					graph.addDemand(currentNode-1, i->first, i->second);
-				currentDestinations.clear();
-			}
-			is >> currentNode;
+		s.skipComments();
+		if(s.atEnd()) break;
+		if(s.peek() == 'O') {
+			s.skipWord();
+			//New origin. Send the old one off if someone's waiting for it.
+			if(stream) sendOrigin();
+			currentNode = s.readInt();
 			continue;
 		} else {
 			//Read in the destination data
-			unsigned toNode;
-			double amount;
-			is >> toNode;
+			unsigned toNode = s.readUnsigned();
 			if(toNode <= zones) toNode += nodes;
-			is.ignore(numeric_limits<streamsize>::max(),':');
-			is >> amount;
+			s.skipPast(':');
+			double amount = s.readDouble();
 			if (amount > 0 && static_cast<int>(toNode) != currentNode)
-				currentDestinations.push_back(pair<unsigned, double>(toNode-1, amount));
-			is.ignore(numeric_limits<streamsize>::max(),';');
+				demand.push_back(InputGraph::Demand(currentNode-1, toNode-1, amount));
+			s.skipPast(';');
 		}
 	}
-	if (!currentDestinations.empty()) {
-		for(vector<pair<unsigned,double> >::iterator i = currentDestinations.begin(); i != currentDestinations.end(); ++i)
-			graph.addDemand(currentNode-1, i->first, i->second);
-	}
 }
 
-void BarGeraImporter::skipComments(std::istream& i)
-{
-	bool haveComment = true, haveSpace = true;
-	if(i.bad()) return;
-	while(true) {
-		haveSpace = false;
-		while(i.good() && isspace(i.peek())) {
-			i.ignore();
-			haveSpace = true;
-		}
-		if(!(haveSpace || haveComment)) return;
-		haveComment = false;
-		while(i.good() && i.peek() == '~') {
-			i.ignore(numeric_limits<streamsize>::max(),'\n');
-			haveComment = true;
-		}
-		if(!(haveSpace || haveComment)) return;
+namespace {
+	bool destinationOrder(const InputGraph::Demand& a, const InputGraph::Demand& b) {
+		return a.to < b.to;
 	}
 }
 
-void BarGeraImporter::endMetadata(std::istream& is)
+void BarGeraImporter::TripsChunk::sendOrigin()
 {
-	//Sometimes there is misc metadata. Ugh. Skip that stuff.
-	while (true) {
-		is.ignore(numeric_limits<streamsize>::max(),'<');//Skip to "end of metadata" hopefully	
-		bool out = true;
-		for(int i = 0; i < 15; ++i) {
-			out = out && (is.get() == "END OF METADATA"[i]);
-		}
-		if(out) break;
+	if(demand.empty() || currentNode < 1) {
+		demand.clear();
+		return;
 	}
-	is.ignore(numeric_limits<streamsize>::max(),'>');
-	
+	//Same order and merging of repeats as InputGraph would give us.
+	stable_sort(demand.begin(), demand.end(), destinationOrder);
+	Origin o(currentNode-1);
+	for(vector<InputGraph::Demand>::iterator i = demand.begin(); i != demand.end(); ++i) {
+		double amount = i->amount;
+		for(; i+1 != demand.end() && (i+1)->to == i->to; ++i)
+			amount += (i+1)->amount;
+		o.addDestination(i->to, amount);
+	}
+	demand.clear();
+	stream->push(o);
 }
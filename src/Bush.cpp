@@ -19,6 +19,7 @@
 
 
 #include "Bush.hpp"
+#include "IntegerBPR.hpp"
 #include <algorithm>
 #include <functional>
 #include <iostream>
@@ -27,28 +28,26 @@
 
 using namespace std;
 
-Bush::Bush(const Origin& o, ABGraph& g, vector<unsigned>& tempStore, vector<unsigned> &reverseTS) :
-origin(o), edges(g.numVertices()+1), sharedNodes(g.nodes()), tempStore(tempStore), reverseTS(reverseTS), graph(g)
+template<typename Cost>
+Bush<Cost>::Bush(const Origin& o, CostGraph<Cost>& g, BushScratch& s, ShortestPathTree& tree, bool loadGraph) :
+origin(o), edges(g.numVertices()+1), scratch(&s), graph(&g)
 {
 	//Set up graph data structure:
-	topologicalOrdering.reserve(g.numVertices());
+	topologicalOrdering.swap(tree.order);
 
-	setUpGraph();
+	setUpGraph(tree.positions);
 	
 	buildTrees();//Sets up predecessors. Unnecessary if we do preds
 	//in Dijkstra.
-	sendInitialFlows();//Sends out initial flow patterns (all-or-nothing)
+	sendInitialFlows(loadGraph);//Sends out initial flow patterns (all-or-nothing)
 	
 	clearChanges();
 }
 
-void Bush::setUpGraph()
+template<typename Cost>
+void Bush<Cost>::setUpGraph(const vector<long>& distanceMap)
 {
-	vector<long> distanceMap(graph.numVertices(), -1);
-		//position of node i in topologicalOrdering
-		//Set up in Dijkstra
-	
-	graph.dijkstra(origin.getOrigin(), distanceMap, topologicalOrdering);
+	//distanceMap: position of node i in topologicalOrdering, from Dijkstra.
 	
 	/*
 	Our Dijkstra routine gives a proper topological ordering, consistent
@@ -61,58 +60,67 @@ void Bush::setUpGraph()
 	//TEST: destination unreachable from origin.
 	for(vector<pair<int, double> >::const_iterator i = origin.dests().begin(); i != origin.dests().end(); ++i) {
 		if(distanceMap.at(i->first) == -1)
-			std::cerr << "Unreachable dest: origin " << origin.getOrigin() << ", dest " << i->first << std::endl;
+			std::cerr << "Unreachable dest: origin " << graph->inputId(origin.getOrigin()) << ", dest " << graph->inputId(i->first) << std::endl;
 	}
 	
-	edgeStorage.reserve(graph.numEdges());
 	for(unsigned i = 0; i < topologicalOrdering.size(); ++i) {
 		edges[i+1] = edges[i];
 		
-		vector<BackwardGraphEdge>::iterator j = graph.edgesFrom(topologicalOrdering.at(i));
-		vector<BackwardGraphEdge>::iterator end = graph.edgesFrom(topologicalOrdering.at(i)+1);
-		for(; j != end; ++j) {
-			unsigned fromPosition = (unsigned)(distanceMap.at(j->fromNode()-&sharedNodes[0]));
+		unsigned id = topologicalOrdering[i];
+		const pair<unsigned, unsigned>* end = graph->inArcs(id+1);
+		for(const pair<unsigned, unsigned>* j = graph->inArcs(id); j != end; ++j) {
+			unsigned fromPosition = (unsigned)(distanceMap[j->second]);
 			if(fromPosition < i) {
 				++edges[i+1];
-				edgeStorage.push_back(BushEdge(&*j));
+				edgeStorage.push_back(BushEdge(j->first, fromPosition));
 			}
 		}
 //		cout << i << "\t" << edges[i] << "\t" << edges[i+1] << endl;
 	}
 }
 
-void Bush::sendInitialFlows()
+template<typename Cost>
+void Bush<Cost>::sendInitialFlows(bool loadGraph)
 {
-	BushNode *root = &sharedNodes.at(origin.getOrigin());
 	for(vector<pair<int, double> >::const_iterator i = origin.dests().begin(); i != origin.dests().end(); ++i) {
 		//For each origin,
-		BushNode* node = &sharedNodes.at(i->first);
-		while(node != root) {
+		unsigned node = scratch->reverseTS[i->first];
+		while(node != 0) {
 			//Flow back to the bush's root
-			BushEdge *be = node->getMinPredecessor();
-			ForwardGraphEdge* fge = graph.forward(be->underlyingEdge());
-			be->addFlow(i->second, fge);
+			BushEdge *be = scratch->nodes.getMinPredecessor(node);
+			if(loadGraph) be->addFlow(i->second, *graph);
+			else be->addFlow(i->second);
 			node = be->fromNode();
 		}
 	}
-}//Performs initial all-or-nothing flows in Bush, adding to both BushEdges and GraphEdges.
+}//Performs initial all-or-nothing flows in Bush, adding to BushEdges and (maybe) GraphEdges.
+
+template<typename Cost>
+void Bush<Cost>::loadInitialFlows()
+{
+	//In edge order, so the graph's sums come out the same however the
+	//bushes were built.
+	for(vector<BushEdge>::const_iterator i = edgeStorage.begin(); i != edgeStorage.end(); ++i)
+		if(i->flow() != 0) graph->addFlow(i->underlyingEdge(), i->flow());
+}
 
-void Bush::printCrap()
+template<typename Cost>
+void Bush<Cost>::printCrap()
 {
 	//Not really used, exists for debugging purposes if I really break something.
+	graph->refreshLengths();
 	cout << "Printing  crap:" <<endl;
 	cout << "In-arcs:"<<endl;
 	
-	for(vector<BushNode>::iterator i = sharedNodes.begin(); i != sharedNodes.end(); ++i) {
+	for(unsigned nodeNum = 0; nodeNum < scratch->nodes.size(); ++nodeNum) {
 
-		long nodeNum = i-sharedNodes.begin();
-		cout << nodeNum << "("<< i->minDist() <<","<< i->maxDist() <<"):";
+		cout << nodeNum << "("<< scratch->nodes.minDist(scratch->reverseTS[nodeNum]) <<","<< scratch->nodes.maxDist(scratch->reverseTS[nodeNum]) <<"):";
 
-		vector<BushEdge>::iterator end = edgeStorage.begin()+edges[reverseTS[nodeNum]+1];
+		vector<BushEdge>::iterator end = edgeStorage.begin()+edges[scratch->reverseTS[nodeNum]+1];
 		
-		for(vector<BushEdge>::iterator j = edgeStorage.begin()+edges[reverseTS[nodeNum]]; j!=end; ++j) {
-			cout << " " << ((j->fromNode()-&sharedNodes[0])) <<
-			        "(" << (j->length()) << "," << (j->flow()) << ") ";
+		for(vector<BushEdge>::iterator j = edgeStorage.begin()+edges[scratch->reverseTS[nodeNum]]; j!=end; ++j) {
+			cout << " " << topologicalOrdering[j->fromNode()] <<
+			        "(" << graph->length(j->underlyingEdge()) << "," << (j->flow()) << ") ";
 		}
 		cout << endl;
 	}
@@ -123,7 +131,8 @@ void Bush::printCrap()
 	cout << endl;
 }
 
-bool Bush::fix(double accuracy)
+template<typename Cost>
+bool Bush<Cost>::fix(double accuracy)
 {
 	bool localFlowChanged = false;
 	do {
@@ -132,30 +141,67 @@ bool Bush::fix(double accuracy)
 	return localFlowChanged;
 }
 
-bool Bush::equilibriateFlows(double accuracy)
+template<typename Cost>
+bool Bush<Cost>::fixEdges()
+{
+	buildTrees();
+	return updateEdges();
+}
+
+template<typename Cost>
+void Bush<Cost>::saveFlows(vector<double>& flows) const
+{
+	flows.clear();
+	for(vector<BushEdge>::const_iterator i = edgeStorage.begin(); i != edgeStorage.end(); ++i)
+		flows.push_back(i->flow());
+}
+
+template<typename Cost>
+void Bush<Cost>::flowChanges(const vector<double>& before, vector<pair<unsigned, double> >& changes) const
+{
+	changes.clear();
+	vector<double>::const_iterator j = before.begin();
+	for(vector<BushEdge>::const_iterator i = edgeStorage.begin(); i != edgeStorage.end(); ++i, ++j)
+		if(i->flow() != *j) changes.push_back(make_pair(i->underlyingEdge(), i->flow()-*j));
+}
+
+template<typename Cost>
+void Bush<Cost>::restoreFlows(const vector<double>& before)
+{
+	vector<double>::const_iterator j = before.begin();
+	for(vector<BushEdge>::iterator i = edgeStorage.begin(); i != edgeStorage.end(); ++i, ++j)
+		i->setFlow(*j);
+}
+
+template<typename Cost>
+bool Bush<Cost>::equilibriateFlows(double accuracy)
 {
 	bool flowsChanged = false;//returns whether we've done any updates on our bush flows.
+	graph->refreshLengths();
 	buildTrees();
 	while (true) {
 		bool thisTime = false;
 		for(vector<pair<int, double> >::const_iterator i = origin.dests().begin(); i != origin.dests().end(); ++i) {
-			if (sharedNodes[i->first].getDifference() > accuracy) {
-				sharedNodes[i->first].equilibriate(graph);
-				//makes it better
-				thisTime = true;
+			unsigned dest = scratch->reverseTS[i->first];
+			if (scratch->nodes.getDifference(dest) > accuracy) {
+				//makes it better, unless it can't move anything. Then
+				//going round again won't help.
+				if(scratch->nodes.equilibriate(dest, *graph)) thisTime = true;
 			}
 		}//Find worst difference.
 		flowsChanged = flowsChanged | thisTime;
 		if(!thisTime) return flowsChanged;
+		graph->refreshLengths();//Flows have moved since last time.
 		buildTrees();
 	}
 	return flowsChanged;
 }
 
-void Bush::buildTrees()
+template<typename Cost>
+void Bush<Cost>::buildTrees()
 {
-	sharedNodes[origin.getOrigin()].setDistance(0.0);
-	reverseTS[origin.getOrigin()]=0;
+	scratch->nodes.setDistance(0, 0.0);
+	scratch->reverseTS[origin.getOrigin()]=0;
 	
 	clearChanges();//Just in case, forget any edges need turning around
 	
@@ -168,18 +214,18 @@ void Bush::buildTrees()
 		++i, ++topoIndex, ++esp
 	) {
 		unsigned id = *i;
-		BushNode &v = sharedNodes[id];
 		
 		vector<BushEdge>::iterator end = edgeStorage.begin()+*(esp+1);
-		v.updateInDistances(evv, end);
+		scratch->nodes.updateInDistances(topoIndex, evv, end, graph->lengths());
 		
-		reverseTS[id]=topoIndex;
+		scratch->reverseTS[id]=topoIndex;
 		
-		updateEdges(evv, end, v.maxDist(), id);
+		updateEdges(evv, end, scratch->nodes.maxDist(topoIndex), id, topoIndex);
 	}
 }//Resets min, max distances, builds min/max trees.
 
-bool Bush::updateEdges()
+template<typename Cost>
+bool Bush<Cost>::updateEdges()
 {
 	if(anyChanges()) {
 		topologicalSort();//Applies changes to be made
@@ -189,7 +235,8 @@ bool Bush::updateEdges()
 	return false;
 }//Switches direction of things that need it.
 
-void Bush::topologicalSort()
+template<typename Cost>
+void Bush<Cost>::topologicalSort()
 {
 	/* Used to be a zero in-degree algorithm, O(V+E). Now just a simple
 	 * O(V log V) sort on nodes' max distance. Note that in real world
@@ -214,27 +261,49 @@ void Bush::topologicalSort()
 	 * Used to do something fun with reverse iterators, but Visual
 	 * Studio barfed on it (some technically illegal behaviour...)
 	 * so I've gone back to old-fashioned indexing. Fun fun.
+	 * 
+	 * Edges name their from-nodes by position, so once every region has
+	 * been re-sorted we go back and fix up the positions that moved.
 	 */
 	
 	long start = deletions.size();
 	
+	unsigned remapUpper = scratch->reverseTS[deletions[start-1].first]+1;
+	unsigned remapLower = remapUpper;
+	
 	for(long i = start; i > 0; start=i) {
 		
-		unsigned upperLimit = reverseTS[deletions[i-1].first];
+		unsigned upperLimit = scratch->reverseTS[deletions[i-1].first];
 		unsigned lowerLimit = upperLimit;
 		
-		for(; i > 0 && reverseTS[deletions[i-1].first] >= lowerLimit; --i) {
-			unsigned fromIndex = reverseTS[deletions[i-1].second->fromNode()-&sharedNodes[0]];
+		for(; i > 0 && scratch->reverseTS[deletions[i-1].first] >= lowerLimit; --i) {
+			unsigned fromIndex = deletions[i-1].second->fromNode();
 			if(lowerLimit > fromIndex) lowerLimit = fromIndex;
 		}
 		
-		sort(deletions.begin()+i, deletions.begin()+start, DeletionsComparator(reverseTS, sharedNodes));
-		sort(additions.begin()+i, additions.begin()+start, AdditionsComparator(reverseTS, sharedNodes));
+		sort(deletions.begin()+i, deletions.begin()+start, DeletionsComparator(scratch->reverseTS, scratch->nodes));
+		sort(additions.begin()+i, additions.begin()+start, AdditionsComparator(scratch->reverseTS, scratch->nodes, *graph));
 		partialTS(lowerLimit, upperLimit+1, start);
+		
+		//Nothing moves between this region and the last one.
+		for(unsigned p = upperLimit+1; p < remapLower; ++p) scratch->positionMap[p] = p;
+		remapLower = lowerLimit;
 	}
+	remapPositions(remapLower, remapUpper);
 }
 
-void Bush::partialTS(unsigned lower, unsigned upper, long start)
+template<typename Cost>
+void Bush<Cost>::remapPositions(unsigned lower, unsigned upper)
+{
+	//Only nodes at or after lower can have in-arcs from [lower, upper).
+	for(vector<BushEdge>::iterator i = edgeStorage.begin()+edges[lower]; i != edgeStorage.end(); ++i) {
+		unsigned from = i->fromNode();
+		if(from >= lower && from < upper) i->setFromNode(scratch->positionMap[from]);
+	}
+}
+
+template<typename Cost>
+void Bush<Cost>::partialTS(unsigned lower, unsigned upper, long start)
 {
 	/*
 	 * This is where the actual topological re-ordering happens. The
@@ -251,36 +320,41 @@ void Bush::partialTS(unsigned lower, unsigned upper, long start)
 	
 	typedef vector<unsigned>::iterator vi;
 	
-	tempStore.clear();
+	scratch->tempStore.clear();
 	
 	vi begin = topologicalOrdering.begin()+lower;
 	vi end = topologicalOrdering.begin()+upper;
 	
 	for(vi i = begin; i != end; ++i) {
-		tempStore.push_back(*i);
+		scratch->tempStore.push_back(*i);
 	}
 	
-	stable_sort(tempStore.begin(), tempStore.end(), NodeIndexComparator(sharedNodes));
+	stable_sort(scratch->tempStore.begin(), scratch->tempStore.end(), NodeIndexComparator(scratch->reverseTS, scratch->nodes));
 	//tempStore is now a sorted list of [distance, id]
 	
+	for(unsigned k = 0; k < scratch->tempStore.size(); ++k) {
+		scratch->positionMap[scratch->reverseTS[scratch->tempStore[k]]] = lower + k;
+	}
+	
 	updateEdgeStorage(upper, lower, start);
 
 	unsigned numIndex=lower;
-	vi tsIndex = tempStore.begin();
+	vi tsIndex = scratch->tempStore.begin();
 	for(vi i = begin; i != end; ++i, ++tsIndex, ++numIndex) {
 		
 		//Last one: update the topological index of the other one?
-		topologicalOrdering[reverseTS[*tsIndex]] = *i;
+		topologicalOrdering[scratch->reverseTS[*tsIndex]] = *i;
 		//set the reverseTS of the old one here to our old location
-		reverseTS[*i] = reverseTS[*tsIndex];
+		scratch->reverseTS[*i] = scratch->reverseTS[*tsIndex];
 		//set our reverseTS to our new location
-		reverseTS[*tsIndex] = numIndex;
+		scratch->reverseTS[*tsIndex] = numIndex;
 		
 		*i = *tsIndex;
 	}
 }
 
-void Bush::updateEdgeStorage(unsigned upper, unsigned lower, long deletionsIt)
+template<typename Cost>
+void Bush<Cost>::updateEdgeStorage(unsigned upper, unsigned lower, long deletionsIt)
 {
 	/*
 	 * TODO: Make this pretty. It is probably the ugliest function in the
@@ -292,17 +366,17 @@ void Bush::updateEdgeStorage(unsigned upper, unsigned lower, long deletionsIt)
 	unsigned edgeIndicesIndex=0;
 	
 	for(
-		vector<unsigned>::reverse_iterator i=tempStore.rbegin();
-		i != tempStore.rend();
+		vector<unsigned>::reverse_iterator i=scratch->tempStore.rbegin();
+		i != scratch->tempStore.rend();
 		++i, ++edgeIndicesIndex
 	) {
 		unsigned id = *i;
-		unsigned tIndex = reverseTS[id];
+		unsigned tIndex = scratch->reverseTS[id];
 		
 		int edgeIt = edges[tIndex+1]-1;
 		for(int edgesEnd = edges[tIndex]; edgeIt >= edgesEnd; --edgeIt) {
-			for(; additionsIt && additions[additionsIt-1].first == id && additions[additionsIt-1].second->fromNode() > edgeStorage[edgeIt].fromNode(); --additionsIt) {
-				vb.push_back(BushEdge(additions[additionsIt-1].second));
+			for(; additionsIt && additions[additionsIt-1].first == id && fromId(additions[additionsIt-1].second) > fromId(edgeStorage[edgeIt]); --additionsIt) {
+				vb.push_back(additions[additionsIt-1].second);
 				++edgeIndices[edgeIndicesIndex];
 			}
 			if (deletionsIt && &edgeStorage[edgeIt] == deletions[deletionsIt-1].second) {
@@ -313,7 +387,7 @@ void Bush::updateEdgeStorage(unsigned upper, unsigned lower, long deletionsIt)
 			}
 		}
 		for(; additionsIt && additions[additionsIt-1].first == id; --additionsIt) {//TODO: do this properly
-			vb.push_back(BushEdge(additions[additionsIt-1].second));
+			vb.push_back(additions[additionsIt-1].second);
 			++edgeIndices[edgeIndicesIndex];
 		}
 	}
@@ -324,7 +398,8 @@ void Bush::updateEdgeStorage(unsigned upper, unsigned lower, long deletionsIt)
 	}
 }
 
-double Bush::allOrNothingCost()
+template<typename Cost>
+double Bush<Cost>::allOrNothingCost()
 {
 	/*
 	NOTE: Probably not too slow (5ms or so on largest test case for all
@@ -335,17 +410,16 @@ double Bush::allOrNothingCost()
 	paste at the moment.
 	*/
 
-	buildTrees();// NOTE: Breaks constness. Grr. Make sharedNodes mutable?
+	buildTrees();// NOTE: Breaks constness. Grr. Make the labels mutable?
 	
 	double cost = 0.0;
-	BushNode* root = &sharedNodes.at(origin.getOrigin());
 	for(vector<pair<int, double> >::const_iterator i = origin.dests().begin(); i != origin.dests().end(); ++i) {
 		//For each origin,
-		BushNode* node = &sharedNodes.at(i->first);
-		while(node != root) {
+		unsigned node = scratch->reverseTS[i->first];
+		while(node != 0) {
 			//Flow back to the bush's root
-			BushEdge *be = node->getMinPredecessor();
-			cost += i->second * be->length();
+			BushEdge *be = scratch->nodes.getMinPredecessor(node);
+			cost += i->second * graph->length(be->underlyingEdge());
 			
 			node = be->fromNode();
 		}
@@ -353,14 +427,19 @@ double Bush::allOrNothingCost()
 	return cost;
 }
 
-Bush::~Bush()
+template<typename Cost>
+Bush<Cost>::~Bush()
 {}
 
-double Bush::maxDifference() {
+template<typename Cost>
+double Bush<Cost>::maxDifference() {
 	buildTrees();
 	double ret = 0.0;
 	for(std::vector<std::pair<int, double> >::const_iterator i = origin.dests().begin(); i != origin.dests().end(); ++i) {
-		ret = max(ret, sharedNodes[i->first].getDifference());
+		ret = max(ret, scratch->nodes.getDifference(scratch->reverseTS[i->first]));
 	}
 	return ret;
 }
+
+template class Bush<CostFunction>;
+template class Bush<IntegerBPR<4> >;
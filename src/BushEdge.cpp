@@ -1,8 +1,9 @@
 #include "BushEdge.hpp"
 #include "ABGraph.hpp"
 
-void BushEdge::swapDirection(ABGraph &g) {
+void BushEdge::swapDirection(ABGraph &g, unsigned position) {
 
-	realEdge = g.forward(realEdge)->getInverse();
+	from = position;
+	edge = g.inverse(edge);
 
 }
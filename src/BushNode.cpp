@@ -21,61 +21,82 @@
 #include "BushNode.hpp"
 
 #include <algorithm> //For min
-#include "SecantSolver.hpp"
+#include "NewtonSolver.hpp"
 #include <iostream>
 #include "ABAdder.hpp"
 #include "ABGraph.hpp"
+#include "IntegerBPR.hpp"
 
 using namespace std;
 
-BushNode::BushNode() :
-	minDistance(numeric_limits<double>::infinity()),
-	maxDistance(numeric_limits<double>::infinity()) {}
+const DistanceKernel BushNodes::kernel = selectDistanceKernel();
 
-bool BushNode::moreSeparatePaths(BushNode*& minNode, BushNode*& maxNode, ABGraph &graph)
+BushNodes::BushNodes(size_t nodes) :
+	minDistance(nodes, numeric_limits<double>::infinity()),
+	maxDistance(nodes, numeric_limits<double>::infinity()),
+	minPredecessor(nodes), maxPredecessor(nodes) {}
+
+bool BushNodes::moreSeparatePaths(unsigned& minNode, unsigned& maxNode)
 {
 	//Precondition: minNode == maxNode?
 	while(true) {
-		if(minNode->minDistance == minNode->maxDistance) return false;//path joins to root
-		else if(minNode->minPredecessor == maxNode->maxPredecessor) {
-			minNode = minNode->minPredecessor->fromNode();
-			maxNode = maxNode->maxPredecessor->fromNode();
+		if(minDistance[minNode] == maxDistance[minNode]) return false;//path joins to root
+		else if(minPredecessor[minNode] == maxPredecessor[maxNode]) {
+			minNode = minPredecessor[minNode]->fromNode();
+			maxNode = maxPredecessor[maxNode]->fromNode();
 		} else return true;//New segments to equilibriate: min/max predecessors are different.
 	}
 }//Ignore min/max paths that coincide
 
 
-void BushNode::fixDifferentPaths(
-               vector<pair<BushEdge*, ForwardGraphEdge*> >& minEdges,
-               vector<pair<BushEdge*, ForwardGraphEdge*> >& maxEdges,
-               double maxChange)
+template<typename Cost>
+double BushNodes::fixDifferentPaths(
+               vector<BushEdge*>& minEdges,
+               vector<BushEdge*>& maxEdges,
+               double maxChange, CostGraph<Cost>& graph)
 {
 
-	ABAdder hp(minEdges.size(), maxEdges.size());
-	for(vector<pair<BushEdge*, ForwardGraphEdge*> >::iterator i = maxEdges.begin(); i != maxEdges.end(); ++i) {
-		hp -= make_pair(i->second->costFunction(), i->second->getFlow());
+	ABAdder<Cost> hp(minEdges.size(), maxEdges.size());
+	for(vector<BushEdge*>::iterator i = maxEdges.begin(); i != maxEdges.end(); ++i) {
+		unsigned e = (*i)->underlyingEdge();
+		hp -= make_pair(graph.costFunction(e), graph.forwardEdge(e).getFlow());
 	}
 	
-	for(vector<pair<BushEdge*, ForwardGraphEdge*> >::iterator i = minEdges.begin(); i != minEdges.end(); ++i) {
-		hp += make_pair(i->second->costFunction(), i->second->getFlow());
+	for(vector<BushEdge*>::iterator i = minEdges.begin(); i != minEdges.end(); ++i) {
+		unsigned e = (*i)->underlyingEdge();
+		hp += make_pair(graph.costFunction(e), graph.forwardEdge(e).getFlow());
 	}
-	SecantSolver<ABAdder> solver;
+	NewtonSolver<ABAdder<Cost> > solver;
 	double newFlow = solver.solve(hp, maxChange, 0);//Change in flow
 	
-	if(newFlow == 0) return;//No change
+	if(newFlow == 0) return 0;//No change
 
 	if(newFlow > maxChange) newFlow = maxChange;
 	//Wait, is this done in the solver now?
 	
-	for(vector<pair<BushEdge*, ForwardGraphEdge*> >::iterator i = minEdges.begin(); i != minEdges.end(); ++i) {
-		i->first->addFlow(newFlow, i->second);
+	//The solver's batches already know what the new lengths will be.
+	const double* minLengths = hp.addedCosts(newFlow);
+	for(size_t i = 0; i < minEdges.size(); ++i) {
+		minEdges[i]->addFlow(newFlow, minLengths[i], graph);
 	}
-	for(vector<pair<BushEdge*, ForwardGraphEdge*> >::iterator i = maxEdges.begin(); i != maxEdges.end(); ++i) {
-		i->first->addFlow(-newFlow, i->second);
+	//Zero-length links mean the min and max segments can share an edge.
+	//Its flow has moved on since the batch was made, so work its length
+	//out again. Segments are short; a scan beats sorting.
+	const double* maxLengths = hp.subtractedCosts(newFlow);
+	for(size_t i = 0; i < maxEdges.size(); ++i) {
+		unsigned e = maxEdges[i]->underlyingEdge();
+		size_t j = 0;
+		while(j < minEdges.size() && minEdges[j]->underlyingEdge() != e) ++j;
+		if(j < minEdges.size())
+			maxEdges[i]->addFlow(-newFlow, graph);
+		else
+			maxEdges[i]->addFlow(-newFlow, maxLengths[i], graph);
 	}
+	return newFlow;
 }
 
-void BushNode::equilibriate(ABGraph& graph)
+template<typename Cost>
+bool BushNodes::equilibriate(unsigned node, CostGraph<Cost>& graph)
 {
 	/*
 	NOTE: It is very important to equilibriate the different distinct segments
@@ -83,33 +104,35 @@ void BushNode::equilibriate(ABGraph& graph)
 	Ford-Fulkerson
 	*/
 	
-	BushNode* minNode = this;
-	BushNode* maxNode = this;
+	unsigned minNode = node;
+	unsigned maxNode = node;
+	bool moved = false;
 
 	while (true) {
-		vector<pair<BushEdge*, ForwardGraphEdge*> > minEdges;
-		vector<pair<BushEdge*, ForwardGraphEdge*> > maxEdges;
+		vector<BushEdge*> minEdges;
+		vector<BushEdge*> maxEdges;
 		double maxChange = numeric_limits<double>::infinity();
 		
 		
-		if(!moreSeparatePaths(minNode, maxNode, graph)) return;
+		if(!moreSeparatePaths(minNode, maxNode)) return moved;
 		//Indicates we're done or sets node positions to start of next segment
 		
 		do { //Trace separate paths back, adding arcs to lists
-			if(minNode->maxDistance >= maxNode->maxDistance) {
-				BushEdge* pred = minNode->minPredecessor;
-				ForwardGraphEdge* fge = graph.forward(pred->underlyingEdge());
-				minEdges.push_back(make_pair(pred, fge));
+			if(maxDistance[minNode] >= maxDistance[maxNode]) {
+				BushEdge* pred = minPredecessor[minNode];
+				minEdges.push_back(pred);
 				minNode = pred->fromNode();
 			} else {
-				BushEdge* pred = maxNode->maxPredecessor;
-				ForwardGraphEdge* fge = graph.forward(pred->underlyingEdge());
+				BushEdge* pred = maxPredecessor[maxNode];
 				maxChange = min(maxChange, pred->flow());
-				maxEdges.push_back(make_pair(pred, fge));
+				maxEdges.push_back(pred);
 				maxNode = pred->fromNode();
 			}
 		} while(minNode != maxNode);
-		if(maxChange > 1e-12) fixDifferentPaths(minEdges, maxEdges, maxChange);
+		if(maxChange > 1e-12 && fixDifferentPaths(minEdges, maxEdges, maxChange, graph) > 1e-12) moved = true;
 	}
 	//Probably the ugliest function in the program now.
 }
+
+template bool BushNodes::equilibriate(unsigned, CostGraph<CostFunction>&);
+template bool BushNodes::equilibriate(unsigned, CostGraph<IntegerBPR<4> >&);
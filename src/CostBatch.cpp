@@ -0,0 +1,185 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "CostBatch.hpp"
+#include "VectorKernels.hpp"
+
+#include <algorithm> //For max
+
+using namespace std;
+
+namespace {
+	/*
+	costs[i] = b[i]*x^power + a[i] with x = flows[i] + delta, and if slopes
+	isn't null, slopes[i] = power*b[i]*x^(power-1) (on the way to the cost
+	anyway). The same multiplications in the same order as
+	CostFunction::operator(), so the costs come out the same. Returns how
+	many it did; the vector kernels leave the tail to scalarPower, which
+	mustn't be inlined into them and lose its fused multiply-add.
+	*/
+	typedef size_t (*PowerKernel)(size_t n, unsigned power, double delta, const double* flows,
+		const double* a, const double* b, double* costs, double* slopes);
+	
+	size_t scalarPower(size_t n, unsigned power, double delta, const double* flows,
+		const double* a, const double* b, double* costs, double* slopes)
+	{
+		for(size_t i = 0; i < n; ++i) {
+			double x = flows[i] + delta;
+			double c = b[i];
+			for(unsigned k = power; k != 1; --k) c *= x;
+			if(slopes) slopes[i] = power*c;
+			costs[i] = c*x + a[i];
+		}
+		return n;
+	}
+
+#ifdef EF_X86_KERNELS
+	EF_KERNEL("avx2")
+	size_t avx2Power(size_t n, unsigned power, double delta, const double* flows,
+		const double* a, const double* b, double* costs, double* slopes)
+	{
+		const __m256d d = _mm256_set1_pd(delta);
+		const __m256d p = _mm256_set1_pd(power);
+		size_t i = 0;
+		for(; i+4 <= n; i += 4) {
+			__m256d x = _mm256_add_pd(_mm256_loadu_pd(flows+i), d);
+			__m256d c = _mm256_loadu_pd(b+i);
+			for(unsigned k = power; k != 1; --k) c = _mm256_mul_pd(c, x);
+			if(slopes) _mm256_storeu_pd(slopes+i, _mm256_mul_pd(p, c));
+			_mm256_storeu_pd(costs+i, EF_MULADD256(c, x, _mm256_loadu_pd(a+i)));
+		}
+		return i;
+	}
+	
+	EF_KERNEL("avx512f")
+	size_t avx512Power(size_t n, unsigned power, double delta, const double* flows,
+		const double* a, const double* b, double* costs, double* slopes)
+	{
+		const __m512d d = _mm512_set1_pd(delta);
+		const __m512d p = _mm512_set1_pd(power);
+		size_t i = 0;
+		for(; i+8 <= n; i += 8) {
+			__m512d x = _mm512_add_pd(_mm512_loadu_pd(flows+i), d);
+			__m512d c = _mm512_loadu_pd(b+i);
+			for(unsigned k = power; k != 1; --k) c = _mm512_mul_pd(c, x);
+			if(slopes) _mm512_storeu_pd(slopes+i, _mm512_mul_pd(p, c));
+			_mm512_storeu_pd(costs+i, EF_MULADD512(c, x, _mm512_loadu_pd(a+i)));
+		}
+		return i;
+	}
+	
+	PowerKernel selectPowerKernel()
+	{
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx512f")) return &avx512Power;
+		if(__builtin_cpu_supports("avx2")) return &avx2Power;
+		return &scalarPower;
+	}
+#else
+	PowerKernel selectPowerKernel()
+	{
+		return &scalarPower;
+	}
+#endif
+
+	const PowerKernel powerKernel = selectPowerKernel();
+	
+	void integerPowers(size_t n, unsigned power, double delta, const double* flows,
+		const double* a, const double* b, double* costs, double* slopes)
+	{
+		size_t i = powerKernel(n, power, delta, flows, a, b, costs, slopes);
+		scalarPower(n-i, power, delta, flows+i, a+i, b+i, costs+i, slopes ? slopes+i : 0);
+	}
+}
+
+void CostBatch<CostFunction>::reserve(size_t n)
+{
+	functions.reserve(n);
+	flows.reserve(n);
+	low.reserve(n);
+	high.reserve(n);
+}
+
+void CostBatch<CostFunction>::push_back(const CostFunction* f, double flow)
+{
+	if(functions.empty()) power = f->power;
+	uniform = uniform && f->type == CostFunction::BPR_INTEGER && f->power == power;
+	fast = fast && f->type == CostFunction::BPR && f->power != 0;
+	straight = straight && f->linear();
+	functions.push_back(f);
+	flows.push_back(flow);
+	low.push_back(f->a);
+	high.push_back(f->b);
+	if(fast) {
+		capacity.push_back(f->c);
+		zeroFlowTime.push_back(f->t);
+		extraCost.push_back(f->e);
+		betaLess.push_back(f->b-1);
+		terms.push_back(f->power);
+		mostTerms = max(mostTerms, f->power);
+	}
+}
+
+void CostBatch<CostFunction>::evaluate(double delta, double* costs) const
+{
+	size_t n = flows.size();
+	if(n == 0) return;
+	if(uniform) integerPowers(n, power, delta, &flows[0], &low[0], &high[0], costs, 0);
+	else if(fast) evaluateFast(delta, costs, 0);
+	else for(size_t i = 0; i < n; ++i) costs[i] = (*functions[i])(flows[i] + delta);
+}
+
+void CostBatch<CostFunction>::evaluate(double delta, double* costs, double* slopes) const
+{
+	size_t n = flows.size();
+	if(n == 0) return;
+	if(uniform) {
+		integerPowers(n, power, delta, &flows[0], &low[0], &high[0], costs, slopes);
+	} else if(fast) {
+		evaluateFast(delta, costs, slopes);
+	} else {
+		for(size_t i = 0; i < n; ++i) {
+			costs[i] = (*functions[i])(flows[i] + delta);
+			slopes[i] = functions[i]->derivative(flows[i] + delta);
+		}
+	}
+}
+
+void CostBatch<CostFunction>::evaluateFast(double delta, double* costs, double* slopes) const
+{
+	//CostFunction's BPR case, with the pows done as a batch.
+	size_t n = flows.size();
+	scratch.resize(n);
+	powers.resize(n);
+	double* x = &scratch[0];
+	double* p = &powers[0];
+	for(size_t i = 0; i < n; ++i) {
+		double flow = flows[i] + delta;
+		x[i] = flow > 0 ? flow/capacity[i] : 0;
+	}
+	FastPow::pow(n, x, &high[0], &terms[0], mostTerms, p);
+	for(size_t i = 0; i < n; ++i)
+		costs[i] = extraCost[i] + zeroFlowTime[i]*(1+low[i]*p[i]);
+	if(!slopes) return;
+	FastPow::pow(n, x, &betaLess[0], &terms[0], mostTerms, p);
+	for(size_t i = 0; i < n; ++i)
+		slopes[i] = zeroFlowTime[i]*low[i]*high[i]*p[i]/capacity[i];
+}
@@ -0,0 +1,86 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "CostFunction.hpp"
+#include <limits>
+#include <functional>
+
+using namespace std;
+
+CostFunction::CostFunction() :
+	type(CONSTANT), power(0), a(numeric_limits<double>::infinity()), b(0), c(0), t(0), e(0) {}
+
+CostFunction::CostFunction(double constant) :
+	type(CONSTANT), power(0), a(constant), b(0), c(0), t(0), e(0) {}
+
+CostFunction::CostFunction(double zeroFlowTime, double capacity, double alpha, double beta, double extraCost, double powError) :
+	type(BPR), power(0), a(alpha), b(beta), c(capacity), t(zeroFlowTime), e(extraCost)
+{
+	if(powError > 0) power = FastPow::termsFor(powError, beta);
+	if(floor(beta) == beta && beta >= 0) {
+		//Coefficients worked out exactly as the old HornerPolynomial
+		//version did, so costs come out bit-for-bit the same.
+		power = static_cast<unsigned>(beta);
+		double scale = 1.0;
+		for(unsigned i = 0; i < power; ++i) scale *= 1/capacity;
+		if(power == 0) {
+			type = CONSTANT;
+			a = (alpha + 1)*zeroFlowTime + extraCost;
+		} else {
+			type = BPR_INTEGER;
+			a = zeroFlowTime + extraCost;
+			b = scale*alpha*zeroFlowTime;
+		}
+		c = t = e = 0;
+	}
+}
+
+CostFunction::CostFunction(const HornerPolynomial& h) :
+	type(POLYNOMIAL), power(0), a(0), b(0), c(0), t(0), e(0), polynomial(new HornerPolynomial(h)) {}
+
+CostFunction::CostFunction(const tr1::function<double(double)>& f) :
+	type(CUSTOM), power(0), a(0), b(0), c(0), t(0), e(0), custom(new tr1::function<double(double)>(f)) {}
+
+void CostFunction::swap(CostFunction& f)
+{
+	std::swap(type, f.type);
+	std::swap(power, f.power);
+	std::swap(a, f.a);
+	std::swap(b, f.b);
+	std::swap(c, f.c);
+	std::swap(t, f.t);
+	std::swap(e, f.e);
+	polynomial.swap(f.polynomial);
+	custom.swap(f.custom);
+}
+
+bool CostFunction::operator<(const CostFunction& f) const
+{
+	if(type != f.type) return type < f.type;
+	if(power != f.power) return power < f.power;
+	if(a != f.a) return a < f.a;
+	if(b != f.b) return b < f.b;
+	if(c != f.c) return c < f.c;
+	if(t != f.t) return t < f.t;
+	if(e != f.e) return e < f.e;
+	if(type == POLYNOMIAL) return *polynomial < *f.polynomial;
+	return std::less<const void*>()(custom.get(), f.custom.get());
+}
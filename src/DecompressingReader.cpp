@@ -0,0 +1,190 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "DecompressingReader.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#define ZLIB_CONST
+#include <zlib.h>
+#ifdef EF_HAVE_ZSTD
+ #include <zstd.h>
+#endif
+
+using namespace std;
+
+DecompressingReader::Format DecompressingReader::format(const char* begin, const char* end)
+{
+	static const unsigned char gzipMagic[] = {0x1f, 0x8b};
+	static const unsigned char zstdMagic[] = {0x28, 0xb5, 0x2f, 0xfd};
+	if(end-begin >= 2 && memcmp(begin, gzipMagic, 2) == 0) return GZIP;
+	if(end-begin >= 4 && memcmp(begin, zstdMagic, 4) == 0) return ZSTD;
+	return NONE;
+}
+
+DecompressingReader::DecompressingReader(const char* begin, const char* end) :
+	begin(begin), end(end), type(format(begin, end)), finished(false), cancelled(false), error(0)
+{
+	if(type != NONE) thread.start(*this);
+}
+
+DecompressingReader::~DecompressingReader()
+{
+	{
+		MLock l(mutex);
+		cancelled = true;//In case the parser bailed out early.
+		changed.broadcast();
+	}
+	thread.join();
+}
+
+bool DecompressingReader::next(const char*& blockBegin, const char*& blockEnd)
+{
+	if(type == NONE) {
+		blockBegin = begin;
+		blockEnd = end;
+		bool first = !finished;
+		finished = true;
+		return first;
+	}
+	MLock l(mutex);
+	while(blocks.empty() && !finished) changed.wait(mutex);
+	if(error) throw error;
+	if(blocks.empty()) return false;
+	current.swap(blocks.front());
+	blocks.pop_front();
+	changed.broadcast();//Room for another block.
+	blockBegin = &current[0];
+	blockEnd = blockBegin + current.size();
+	return true;
+}
+
+void DecompressingReader::operator()()
+{
+	if(type == GZIP) inflateGzip();
+	else if(type == ZSTD) inflateZstd();
+	MLock l(mutex);
+	finished = true;
+	changed.broadcast();
+}
+
+bool DecompressingReader::emit(vector<char>& block, bool last)
+{
+	vector<char> carry;
+	if(!last) {
+		vector<char>::reverse_iterator newline = find(block.rbegin(), block.rend(), '\n');
+		if(newline == block.rend()) return true;//One enormous line. Keep going.
+		carry.assign(newline.base(), block.end());
+		block.erase(newline.base(), block.end());
+	}
+	{
+		MLock l(mutex);
+		while(blocks.size() >= maxQueued && !cancelled) changed.wait(mutex);
+		if(cancelled) return false;
+		if(!block.empty()) {
+			blocks.push_back(vector<char>());
+			blocks.back().swap(block);
+			changed.broadcast();
+		}
+	}
+	block.swap(carry);
+	block.reserve(blockSize + blockSize/4);
+	return true;
+}
+
+void DecompressingReader::inflateGzip()
+{
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+	if(inflateInit2(&z, 15+32) != Z_OK) {//+32: detect gzip or zlib headers
+		MLock l(mutex);
+		error = "Could not start gzip decompression";
+		return;
+	}
+	const char* in = begin;
+	vector<char> block;
+	block.reserve(blockSize + blockSize/4);
+	while(true) {
+		//zlib counts in 32 bits, so feed big files a gigabyte at a time.
+		if(z.avail_in == 0 && in != end) {
+			std::size_t n = min<std::size_t>(static_cast<std::size_t>(end-in), 1 << 30);
+			z.next_in = reinterpret_cast<const Bytef*>(in);
+			z.avail_in = static_cast<uInt>(n);
+			in += n;
+		}
+		std::size_t used = block.size();
+		std::size_t space = 1 << 18;
+		block.resize(used + space);
+		z.next_out = reinterpret_cast<Bytef*>(&block[used]);
+		z.avail_out = static_cast<uInt>(space);
+		int ret = inflate(&z, Z_NO_FLUSH);
+		block.resize(used + (space - z.avail_out));
+
+		if(ret == Z_STREAM_END) {
+			if(z.avail_in == 0 && in == end) break;
+			inflateReset(&z);//Concatenated gzip members, e.g. from pigz or cat.
+		} else if(ret != Z_OK && !(ret == Z_BUF_ERROR && (z.avail_in != 0 || in != end))) {
+			MLock l(mutex);
+			error = (ret == Z_BUF_ERROR) ? "Truncated gzip file" : "Corrupt gzip file";
+			break;
+		}
+		if(block.size() >= blockSize && !emit(block, false)) break;
+	}
+	inflateEnd(&z);
+	if(!error) emit(block, true);
+}
+
+void DecompressingReader::inflateZstd()
+{
+#ifdef EF_HAVE_ZSTD
+	ZSTD_DCtx* context = ZSTD_createDCtx();
+	ZSTD_inBuffer in = {begin, static_cast<std::size_t>(end-begin), 0};
+	vector<char> block;
+	block.reserve(blockSize + blockSize/4);
+	std::size_t hint = 1;
+	while(in.pos < in.size || hint == 0) {
+		std::size_t used = block.size();
+		std::size_t space = 1 << 18;
+		block.resize(used + space);
+		ZSTD_outBuffer out = {&block[used], space, 0};
+		hint = ZSTD_decompressStream(context, &out, &in);
+		block.resize(used + out.pos);
+		if(ZSTD_isError(hint)) {
+			MLock l(mutex);
+			error = "Corrupt zstd file";
+			break;
+		}
+		if(in.pos == in.size && out.pos < space) {
+			if(hint != 0) {
+				MLock l(mutex);
+				error = "Truncated zstd file";
+			}
+			break;
+		}
+		if(block.size() >= blockSize && !emit(block, false)) break;
+	}
+	ZSTD_freeDCtx(context);
+	if(!error) emit(block, true);
+#else
+	MLock l(mutex);
+	error = "zstd input needs a build with EF_HAVE_ZSTD";
+#endif
+}
@@ -0,0 +1,239 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "DistanceKernel.hpp"
+#include "VectorKernels.hpp"
+
+#include <limits>
+
+using namespace std;
+
+#ifdef EF_X86_KERNELS
+
+/*
+The kernels read BushEdges straight out of memory as {edge, from} (one
+64-bit lane, edge in the low half) followed by the flow, 16 bytes each.
+*/
+typedef char BushEdgeLayoutCheck[sizeof(BushEdge) == 16 ? 1 : -1];
+
+namespace {
+	/*
+	Each lane keeps the earliest best candidate it has seen (strict
+	comparisons), so picking the best lane, lowest index on ties, gives the
+	same arc as the scalar loop. Three reductions at once:
+	- min of min-dist candidates over all arcs,
+	- min of max-dist candidates over all arcs (used if nothing has flow),
+	- max of max-dist candidates over arcs with flow.
+	*/
+	struct Best {
+		double value, index;
+	};
+
+	inline void pickLower(Best& b, double value, double index) {
+		if(value < b.value || (value == b.value && index < b.index)) {
+			b.value = value;
+			b.index = index;
+		}
+	}
+
+	inline void pickHigher(Best& b, double value, double index) {
+		if(value > b.value || (value == b.value && index < b.index)) {
+			b.value = value;
+			b.index = index;
+		}
+	}
+
+	void finish(const Best& min, const Best& low, const Best& high, bool anyUsed, InDistances& result) {
+		result.minDist = min.value;
+		result.minPred = static_cast<size_t>(min.index);
+		const Best& max = anyUsed ? high : low;
+		result.maxDist = max.value;
+		result.maxPred = static_cast<size_t>(max.index);
+	}
+
+	EF_KERNEL("avx2")
+	void avx2Kernel(const BushEdge* arcs, size_t count, const double* lengths,
+		const double* minDistances, const double* maxDistances, InDistances& result)
+	{
+		const double infinity = numeric_limits<double>::infinity();
+		const __m256d inf = _mm256_set1_pd(infinity);
+		const __m256d threshold = _mm256_set1_pd(1e-10);//As in BushEdge::used()
+		const __m256d four = _mm256_set1_pd(4.0);
+		const __m256d lanes = _mm256_setr_pd(0.0, 1.0, 2.0, 3.0);
+		const __m256i split = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+		const __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+
+		__m256d bestMin = inf, bestMinIndex = _mm256_setzero_pd();
+		__m256d bestLow = inf, bestLowIndex = _mm256_setzero_pd();
+		__m256d bestHigh = _mm256_set1_pd(-infinity), bestHighIndex = _mm256_setzero_pd();
+		__m256d anyUsed = _mm256_setzero_pd();
+		__m256d index = lanes;
+
+		const double* raw = reinterpret_cast<const double*>(arcs);
+		for(size_t i = 0; i < count; i += 4, raw += 8) {
+			__m256d first, second, live;
+			size_t left = count - i;
+			if(left >= 4) {
+				first = _mm256_loadu_pd(raw);
+				second = _mm256_loadu_pd(raw+4);
+				live = all;
+			} else {
+				//Don't read past the last arc. Missing lanes load as zero, which
+				//is a safe index; we blank their results out below.
+				long long l = static_cast<long long>(left);
+				__m256i firstMask = _mm256_setr_epi64x(-1, -1, l > 1 ? -1 : 0, l > 1 ? -1 : 0);
+				__m256i secondMask = _mm256_setr_epi64x(l > 2 ? -1 : 0, l > 2 ? -1 : 0, 0, 0);
+				first = _mm256_maskload_pd(raw, firstMask);
+				second = _mm256_maskload_pd(raw+4, secondMask);
+				live = _mm256_cmp_pd(lanes, _mm256_set1_pd(static_cast<double>(left)), _CMP_LT_OQ);
+			}
+			//first = [ids0, flow0, ids1, flow1], second = [ids2, flow2, ids3, flow3]
+			__m256d ids = _mm256_permute4x64_pd(_mm256_unpacklo_pd(first, second), _MM_SHUFFLE(3, 1, 2, 0));
+			__m256d flows = _mm256_permute4x64_pd(_mm256_unpackhi_pd(first, second), _MM_SHUFFLE(3, 1, 2, 0));
+			__m256i split32 = _mm256_permutevar8x32_epi32(_mm256_castpd_si256(ids), split);
+			__m128i edges = _mm256_castsi256_si128(split32);
+			__m128i froms = _mm256_extracti128_si256(split32, 1);
+
+			//Masked forms with an explicit source, the plain ones upset -Wall on GCC 12.
+			__m256d length = _mm256_mask_i32gather_pd(inf, lengths, edges, all, 8);
+			__m256d fromMin = _mm256_add_pd(_mm256_mask_i32gather_pd(inf, minDistances, froms, all, 8), length);
+			__m256d fromMax = _mm256_add_pd(_mm256_mask_i32gather_pd(inf, maxDistances, froms, all, 8), length);
+			fromMin = _mm256_blendv_pd(inf, fromMin, live);
+			__m256d fromLow = _mm256_blendv_pd(inf, fromMax, live);
+			__m256d used = _mm256_and_pd(_mm256_cmp_pd(flows, threshold, _CMP_GT_OQ), live);
+
+			__m256d better = _mm256_cmp_pd(fromMin, bestMin, _CMP_LT_OQ);
+			bestMin = _mm256_blendv_pd(bestMin, fromMin, better);
+			bestMinIndex = _mm256_blendv_pd(bestMinIndex, index, better);
+
+			better = _mm256_cmp_pd(fromLow, bestLow, _CMP_LT_OQ);
+			bestLow = _mm256_blendv_pd(bestLow, fromLow, better);
+			bestLowIndex = _mm256_blendv_pd(bestLowIndex, index, better);
+
+			better = _mm256_and_pd(_mm256_cmp_pd(fromMax, bestHigh, _CMP_GT_OQ), used);
+			bestHigh = _mm256_blendv_pd(bestHigh, fromMax, better);
+			bestHighIndex = _mm256_blendv_pd(bestHighIndex, index, better);
+
+			anyUsed = _mm256_or_pd(anyUsed, used);
+			index = _mm256_add_pd(index, four);
+		}
+
+		double v[3][4], ix[3][4];
+		_mm256_storeu_pd(v[0], bestMin);
+		_mm256_storeu_pd(ix[0], bestMinIndex);
+		_mm256_storeu_pd(v[1], bestLow);
+		_mm256_storeu_pd(ix[1], bestLowIndex);
+		_mm256_storeu_pd(v[2], bestHigh);
+		_mm256_storeu_pd(ix[2], bestHighIndex);
+		Best min = {v[0][0], ix[0][0]}, low = {v[1][0], ix[1][0]}, high = {v[2][0], ix[2][0]};
+		for(unsigned lane = 1; lane < 4; ++lane) {
+			pickLower(min, v[0][lane], ix[0][lane]);
+			pickLower(low, v[1][lane], ix[1][lane]);
+			pickHigher(high, v[2][lane], ix[2][lane]);
+		}
+		finish(min, low, high, _mm256_movemask_pd(anyUsed) != 0, result);
+	}
+
+	EF_KERNEL("avx512f")
+	void avx512Kernel(const BushEdge* arcs, size_t count, const double* lengths,
+		const double* minDistances, const double* maxDistances, InDistances& result)
+	{
+		const double infinity = numeric_limits<double>::infinity();
+		const __m512d inf = _mm512_set1_pd(infinity);
+		const __m512d threshold = _mm512_set1_pd(1e-10);//As in BushEdge::used()
+		const __m512d eight = _mm512_set1_pd(8.0);
+		const __m512i evens = _mm512_setr_epi64(0, 2, 4, 6, 8, 10, 12, 14);
+		const __m512i odds = _mm512_setr_epi64(1, 3, 5, 7, 9, 11, 13, 15);
+
+		__m512d bestMin = inf, bestMinIndex = _mm512_setzero_pd();
+		__m512d bestLow = inf, bestLowIndex = _mm512_setzero_pd();
+		__m512d bestHigh = _mm512_set1_pd(-infinity), bestHighIndex = _mm512_setzero_pd();
+		__mmask8 anyUsed = 0;
+		__m512d index = _mm512_setr_pd(0.0, 1.0, 2.0, 3.0, 4.0, 5.0, 6.0, 7.0);
+
+		const double* raw = reinterpret_cast<const double*>(arcs);
+		for(size_t i = 0; i < count; i += 8, raw += 16) {
+			size_t left = count - i;
+			__mmask8 live = left >= 8 ? 0xFF : static_cast<__mmask8>((1u << left) - 1);
+			size_t words = left >= 8 ? 16 : 2*left;
+			__mmask8 firstMask = words >= 8 ? 0xFF : static_cast<__mmask8>((1u << words) - 1);
+			__mmask8 secondMask = words >= 16 ? 0xFF : words > 8 ? static_cast<__mmask8>((1u << (words-8)) - 1) : 0;
+			__m512d first = _mm512_maskz_loadu_pd(firstMask, raw);
+			__m512d second = _mm512_maskz_loadu_pd(secondMask, raw+8);
+
+			__m512i ids = _mm512_castpd_si512(_mm512_permutex2var_pd(first, evens, second));
+			__m512d flows = _mm512_permutex2var_pd(first, odds, second);
+			__m256i edges = _mm512_maskz_cvtepi64_epi32(0xFF, ids);
+			__m256i froms = _mm512_maskz_cvtepi64_epi32(0xFF, _mm512_maskz_srli_epi64(0xFF, ids, 32));
+
+			__m512d length = _mm512_mask_i32gather_pd(inf, live, edges, lengths, 8);
+			__m512d fromMin = _mm512_mask_add_pd(inf, live, _mm512_mask_i32gather_pd(inf, live, froms, minDistances, 8), length);
+			__m512d fromMax = _mm512_mask_add_pd(inf, live, _mm512_mask_i32gather_pd(inf, live, froms, maxDistances, 8), length);
+			__mmask8 used = _mm512_mask_cmp_pd_mask(live, flows, threshold, _CMP_GT_OQ);
+
+			__mmask8 better = _mm512_cmp_pd_mask(fromMin, bestMin, _CMP_LT_OQ);
+			bestMin = _mm512_mask_blend_pd(better, bestMin, fromMin);
+			bestMinIndex = _mm512_mask_blend_pd(better, bestMinIndex, index);
+
+			better = _mm512_cmp_pd_mask(fromMax, bestLow, _CMP_LT_OQ);
+			bestLow = _mm512_mask_blend_pd(better, bestLow, fromMax);
+			bestLowIndex = _mm512_mask_blend_pd(better, bestLowIndex, index);
+
+			better = _mm512_mask_cmp_pd_mask(used, fromMax, bestHigh, _CMP_GT_OQ);
+			bestHigh = _mm512_mask_blend_pd(better, bestHigh, fromMax);
+			bestHighIndex = _mm512_mask_blend_pd(better, bestHighIndex, index);
+
+			anyUsed = static_cast<__mmask8>(anyUsed | used);
+			index = _mm512_add_pd(index, eight);
+		}
+
+		double v[3][8], ix[3][8];
+		_mm512_storeu_pd(v[0], bestMin);
+		_mm512_storeu_pd(ix[0], bestMinIndex);
+		_mm512_storeu_pd(v[1], bestLow);
+		_mm512_storeu_pd(ix[1], bestLowIndex);
+		_mm512_storeu_pd(v[2], bestHigh);
+		_mm512_storeu_pd(ix[2], bestHighIndex);
+		Best min = {v[0][0], ix[0][0]}, low = {v[1][0], ix[1][0]}, high = {v[2][0], ix[2][0]};
+		for(unsigned lane = 1; lane < 8; ++lane) {
+			pickLower(min, v[0][lane], ix[0][lane]);
+			pickLower(low, v[1][lane], ix[1][lane]);
+			pickHigher(high, v[2][lane], ix[2][lane]);
+		}
+		finish(min, low, high, anyUsed != 0, result);
+	}
+}
+
+DistanceKernel selectDistanceKernel()
+{
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx512f")) return &avx512Kernel;
+	if(__builtin_cpu_supports("avx2")) return &avx2Kernel;
+	return 0;
+}
+
+#else
+
+DistanceKernel selectDistanceKernel()
+{
+	return 0;
+}
+
+#endif
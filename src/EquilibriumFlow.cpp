@@ -21,41 +21,118 @@
 #include <utility> //For Pair
 #include <iostream>
 #include <fstream>
+#include <string>
 #include <cstdlib> //For EXIT_SUCCESS
+#include <exception> //For exception_ptr
 
 #include "MTimer.hpp"
 #include "AlgorithmBSolver.hpp"
+#include "IntegerBPR.hpp"
 #include "BarGeraImporter.hpp"
 #include "InputGraph.hpp"
+#include "OriginQueue.hpp"
+#include "MThread.hpp"
 
 using namespace std;
 
-void general(const char* netString, const char* tripString, double distanceFactor=0.0, double tollFactor=0.0, double gap = 1e-13)
+//Runs the solver to the requested gap, printing progress (wall time, gap,
+//iterations so far) and the final flows. Working out the gap takes a
+//while on big networks, so it counts towards the time too.
+template<typename Cost>
+void solve(AlgorithmBSolver<Cost>& abs, double time, double gap, unsigned roundSize)
 {
-	ifstream network(netString), trips(tripString);
-	BarGeraImporter bgi(distanceFactor, tollFactor);
-	InputGraph ig;
-	MTimer timer3;
-	bgi.readInGraph(ig, network, trips);
-	cout << timer3.elapsed() << endl;
+	MTimer t2;
+	double thisGap;
+	unsigned iterations = 0;
+	for(thisGap = abs.averageExcessCost(); thisGap > gap; thisGap = abs.averageExcessCost()) {
+		cout << time + t2.elapsed() << ' ' << thisGap << ' ' << iterations << endl;
+		iterations += abs.solve(12, roundSize);
+	}
+	cout << time + t2.elapsed() << ' ' << thisGap << ' ' << iterations << endl;
+	cout << abs << endl;
+}
+
+//Parses the trips file on its own thread, feeding origins to the solver.
+//Whatever it throws is kept for the main thread to rethrow after join().
+class TripsReader {
+	public:
+		TripsReader(BarGeraImporter& bgi, const char* file, OriginQueue& origins) :
+			bgi(bgi), file(file), origins(origins) {}
+		void operator()() {
+			try {
+				bgi.readInTrips(file, origins);
+			} catch(...) {
+				error = current_exception();
+			}
+		}
+		BarGeraImporter& bgi;
+		const char* file;
+		OriginQueue& origins;
+		exception_ptr error;
+};
 
+//Builds the bushes once everything's been read in.
+template<typename Cost>
+void solveRead(const InputGraph& ig, double gap, ABGraph::NodeOrdering ordering, bool stopAtDestinations, unsigned batchSize, unsigned threads, unsigned roundSize)
+{
 	MTimer timer1;
 
-	AlgorithmBSolver abs(ig);
+	AlgorithmBSolver<Cost> abs(ig, ordering, stopAtDestinations, batchSize, threads);
 	double time=0.0;
 	cout << (time += timer1.elapsed()) << endl;//*/
-//*/
-	double thisGap;
-	for(thisGap = abs.averageExcessCost(); thisGap > gap; thisGap = abs.averageExcessCost()) {
-		cout << time << ' ' << thisGap << endl;
-		MTimer t2;
-		//cout << i << endl;
-		abs.solve(12);
-		time += t2.elapsed();
+	solve(abs, time, gap, roundSize);
+}
+
+//Builds the bushes as the trips file is parsed.
+template<typename Cost>
+void solvePipelined(BarGeraImporter& bgi, const InputGraph& ig, const char* tripString, double gap, ABGraph::NodeOrdering ordering, bool stopAtDestinations, unsigned batchSize, unsigned threads, unsigned roundSize, MTimer& timer3)
+{
+	OriginQueue origins;
+	TripsReader reader(bgi, tripString, origins);
+	MThread thread;
+	thread.start(reader);
+	AlgorithmBSolver<Cost> abs(ig, origins, ordering, stopAtDestinations, batchSize, threads);
+	thread.join();
+	if(reader.error) rethrow_exception(reader.error);
+	
+	double time = timer3.elapsed();
+	double megabytes = static_cast<double>(bgi.bytesRead())/1048576.0;
+	cout << "Read " << megabytes << " MB and built bushes in " << time << "s" << endl;
+	cout << time << endl;
+	solve(abs, time, gap, roundSize);
+}
+
+//Whether the solver can be built on IntegerBPR<4>, the usual TNTP case.
+bool allQuarticBPR(const InputGraph& ig)
+{
+	for(vector<InputGraph::Edge>::const_iterator i = ig.graph().begin(); i != ig.graph().end(); ++i)
+		if(!IntegerBPR<4>::fits(i->vdf)) return false;
+	return true;
+}
+
+void general(const char* netString, const char* tripString, double distanceFactor=0.0, double tollFactor=0.0, double gap = 1e-13, const char* cacheString = 0, ABGraph::NodeOrdering ordering = ABGraph::INPUT_ORDER, double powError = 0.0, bool stopAtDestinations = false, unsigned batchSize = 1, unsigned threads = MThread::hardwareThreads(), unsigned roundSize = 1)
+{
+	BarGeraImporter bgi(distanceFactor, tollFactor);
+	bgi.setPowError(powError);
+	InputGraph ig;
+	MTimer timer3;
+	if(cacheString) {
+		bgi.readInGraph(ig, netString, tripString, cacheString);
+		double importTime = timer3.elapsed();
+		cout << importTime << endl;
+		double megabytes = static_cast<double>(bgi.bytesRead())/1048576.0;
+		cout << "Read " << megabytes << " MB at " << megabytes/importTime << " MB/s" << endl;
+
+		if(allQuarticBPR(ig)) solveRead<IntegerBPR<4> >(ig, gap, ordering, stopAtDestinations, batchSize, threads, roundSize);
+		else solveRead<CostFunction>(ig, gap, ordering, stopAtDestinations, batchSize, threads, roundSize);
+	} else {
+		//No cache: overlap parsing the trips with building bushes.
+		bgi.readInNetwork(ig, netString);
+		cout << timer3.elapsed() << endl;
+		
+		if(allQuarticBPR(ig)) solvePipelined<IntegerBPR<4> >(bgi, ig, tripString, gap, ordering, stopAtDestinations, batchSize, threads, roundSize, timer3);
+		else solvePipelined<CostFunction>(bgi, ig, tripString, gap, ordering, stopAtDestinations, batchSize, threads, roundSize, timer3);
 	}
-	cout << time << ' ' << thisGap << endl;
-	cout << abs << endl;
-//*/
 }
 
 class func {
@@ -66,29 +143,68 @@ class func {
 		double first, second;
 };
 
+ABGraph::NodeOrdering parseOrdering(const string& s)
+{
+	if(s == "bfs") return ABGraph::BFS_ORDER;
+	if(s == "rcm") return ABGraph::RCM_ORDER;
+	if(s == "input") return ABGraph::INPUT_ORDER;
+	throw "Node ordering should be one of input, bfs or rcm";
+}
+
+bool parseDijkstra(const string& s)
+{
+	if(s == "stop") return true;
+	if(s == "full") return false;
+	throw "Dijkstra should be full or stop";
+}
+
 int main (int argc, char **argv)
 {
+	//GEF network trips [distanceFactor tollFactor gap [cache [ordering [powError [dijkstra [batch [threads [round]]]]]]]]
+	//cache can be "-" for none; ordering is input (default), bfs or rcm.
+	//powError > 0 lets fractional-beta links use an approximate pow.
+	//dijkstra is full (default) or stop, to stop at the last destination.
+	//batch is how many origins' bushes are built against the same link
+	//lengths, on up to threads threads (default one per core).
+	//round is how many bushes get fixed at a time, shared between the same
+	//threads; the default of 1 fixes them one after another. The answer
+	//depends on round but not on threads.
+	if(argc >= 3) {
+		general(argv[1], argv[2],
+			argc > 3 ? atof(argv[3]) : 0.0,
+			argc > 4 ? atof(argv[4]) : 0.0,
+			argc > 5 ? atof(argv[5]) : 1e-13,
+			argc > 6 && string(argv[6]) != "-" ? argv[6] : 0,
+			argc > 7 ? parseOrdering(argv[7]) : ABGraph::INPUT_ORDER,
+			argc > 8 ? atof(argv[8]) : 0.0,
+			argc > 9 ? parseDijkstra(argv[9]) : false,
+			argc > 10 ? atoi(argv[10]) : 1,
+			argc > 11 ? atoi(argv[11]) : MThread::hardwareThreads(),
+			argc > 12 ? atoi(argv[12]) : 1);
+		return EXIT_SUCCESS;
+	}
 //	general("networks/ChicagoSketch_net.txt", "networks/ChicagoSketch_trips.txt", 0.04, 0.02);
 //	general("networks/Braess_net.txt", "networks/Braess_trips.txt");
 //	general("networks/Auckland_net2.txt", "networks/Auckland_trips.txt");
 //	general("networks/SiouxFalls_net.txt", "networks/SiouxFalls_trips.txt");
 //	general("networks/Anaheim_net.txt", "networks/Anaheim_trips.txt");
-	general("networks/ChicagoRegional_net.txt", "networks/ChicagoRegional_trips.txt", 0.25, 0.1, 1e-5);
+	general("networks/ChicagoRegional_net.txt", "networks/ChicagoRegional_trips.txt", 0.25, 0.1, 1e-5, "networks/ChicagoRegional.efc");
 //	general("networks/Philadelphia_network.txt", "networks/Philadelphia_trips.txt", 0.0, 0.055, 1e-4);
 
 	 //Braess' network paradox
 /*	InputGraph g;
 	g.setNodes(5);
-	g.addEdge(0, 1, func(0.5,0));
-	g.addEdge(0, 4, func(0.5,0));
-	g.addEdge(0, 2, func(1.5,0));
-	g.addEdge(0, 3, func(2.5,0));
-	g.addEdge(1, 4, func(0.5,3));
-	g.addEdge(2, 4, func(0.5,1));
-	g.addEdge(3, 4, func(0.5,2));
+	g.addEdge(0, 1, InputGraph::VDF(func(0.5,0)));
+	g.addEdge(0, 4, InputGraph::VDF(func(0.5,0)));
+	g.addEdge(0, 2, InputGraph::VDF(func(1.5,0)));
+	g.addEdge(0, 3, InputGraph::VDF(func(2.5,0)));
+	g.addEdge(1, 4, InputGraph::VDF(func(0.5,3)));
+	g.addEdge(2, 4, InputGraph::VDF(func(0.5,1)));
+	g.addEdge(3, 4, InputGraph::VDF(func(0.5,2)));
 	
 	g.addDemand(0, 4, 20.0);
-	AlgorithmBSolver abs(g);
+	g.finalise();
+	AlgorithmBSolver<CostFunction> abs(g);
 	cout << abs << endl;
 	abs.solve(1);
 	cout << abs << endl;
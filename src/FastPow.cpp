@@ -0,0 +1,238 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "FastPow.hpp"
+#include "VectorKernels.hpp"
+
+using namespace std;
+
+namespace {
+	typedef size_t (*PowKernel)(size_t, const double*, const double*, const unsigned*, unsigned, double*,
+		const double*, const double*);
+}
+
+const double FastPow::inverseOdd[maxTerms] = {
+	1.0, 1.0/3, 1.0/5, 1.0/7, 1.0/9, 1.0/11, 1.0/13, 1.0/15, 1.0/17, 1.0/19
+};
+
+const double FastPow::inverseFactorial[maxTerms+4] = {
+	1.0, 1.0, 1.0/2, 1.0/6, 1.0/24, 1.0/120, 1.0/720, 1.0/5040, 1.0/40320,
+	1.0/362880, 1.0/3628800, 1.0/39916800, 1.0/479001600, 1.0/6227020800.0
+};
+
+double FastPow::errorBound(unsigned terms, double y)
+{
+	if(terms == 0 || terms > maxTerms) return 0;//std::pow
+	const double sMax = 0.17157287525381;//(sqrt(2)-1)/(sqrt(2)+1)
+	const double gMax = 0.34657359027997;//ln(2)/2
+	
+	//Tail of the atanh series, then what an error in z does to 2^z.
+	double logError = 2.8853900817779268*std::pow(sMax, 2.0*terms+1)/(2.0*terms+1)/(1-sMax*sMax);
+	double zError = std::fabs(y)*logError;
+	double fromLog = std::exp(0.69314718055994531*zError)-1;
+	
+	//Taylor remainder for e^g, relative to e^g >= e^-gMax.
+	unsigned degree = terms+3;
+	double fromExp = std::pow(gMax, degree+1.0)*inverseFactorial[degree]/(degree+1)*std::exp(2*gMax);
+	
+	//Rounding, mostly in y*log2(x) when it's large.
+	const double rounding = 1e-12;
+	return fromLog + fromExp + rounding;
+}
+
+unsigned FastPow::termsFor(double maxRelativeError, double y)
+{
+	for(unsigned terms = 1; terms <= maxTerms; ++terms)
+		if(errorBound(terms, y) <= maxRelativeError) return terms;
+	return 0;
+}
+
+#ifdef EF_X86_KERNELS
+
+/*
+The batch kernels are FastPow::pow a lane at a time: the same operations in
+the same order. Lanes can want different numbers of terms, so both series
+run to the most any lane wants, with a zero coefficient while a lane is
+still above its own count. That leaves its sum at exactly zero until it
+starts, just like the scalar loop. Lanes the scalar code would hand to
+std::pow get computed anyway (harmlessly) and then redone. They return how
+far they got.
+*/
+namespace {
+	EF_KERNEL("avx2")
+	size_t avx2Pow(size_t n, const double* x, const double* y, const unsigned* terms, unsigned mostTerms, double* out,
+		const double* inverseOdd, const double* inverseFactorial)
+	{
+		const __m256d one = _mm256_set1_pd(1.0), half = _mm256_set1_pd(0.5), four = _mm256_set1_pd(4.0);
+		const __m256d sqrt2 = _mm256_set1_pd(1.4142135623730951);
+		const __m256d twoOverLn2 = _mm256_set1_pd(2.8853900817779268);
+		const __m256d ln2 = _mm256_set1_pd(0.69314718055994531);
+		const __m256d smallest = _mm256_set1_pd(numeric_limits<double>::min());
+		const __m256d largest = _mm256_set1_pd(numeric_limits<double>::max());
+		const __m256d limit = _mm256_set1_pd(1000.0);
+		const __m256d magnitude = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+		const __m256i mantissa = _mm256_set1_epi64x(0x000fffffffffffffLL);
+		const __m256i oneBits = _mm256_set1_epi64x(0x3ff0000000000000LL);
+		//Small whole numbers to and from doubles by way of 2^52's mantissa.
+		const __m256d shift = _mm256_set1_pd(4503599627370496.0);
+		const __m256i shiftBits = _mm256_castpd_si256(shift);
+		const __m256d bias = _mm256_set1_pd(1023.0);
+		
+		size_t i = 0;
+		for(; i+4 <= n; i += 4) {
+			__m256d xs = _mm256_loadu_pd(x+i);
+			__m256d ys = _mm256_loadu_pd(y+i);
+			__m256d count = _mm256_cvtepi32_pd(_mm_loadu_si128(reinterpret_cast<const __m128i*>(terms+i)));
+			__m256d fine = _mm256_and_pd(_mm256_cmp_pd(xs, smallest, _CMP_GE_OQ), _mm256_cmp_pd(xs, largest, _CMP_LE_OQ));
+			
+			__m256i bits = _mm256_castpd_si256(xs);
+			__m256d exponent = _mm256_sub_pd(_mm256_sub_pd(_mm256_castsi256_pd(
+				_mm256_or_si256(_mm256_srli_epi64(bits, 52), shiftBits)), shift), bias);
+			__m256d m = _mm256_castsi256_pd(_mm256_or_si256(_mm256_and_si256(bits, mantissa), oneBits));
+			__m256d high = _mm256_cmp_pd(m, sqrt2, _CMP_GT_OQ);
+			m = _mm256_blendv_pd(m, _mm256_mul_pd(m, half), high);
+			exponent = _mm256_blendv_pd(exponent, _mm256_add_pd(exponent, one), high);
+			
+			__m256d s = _mm256_div_pd(_mm256_sub_pd(m, one), _mm256_add_pd(m, one));
+			__m256d s2 = _mm256_mul_pd(s, s);
+			__m256d sum = _mm256_setzero_pd();
+			for(unsigned k = mostTerms; k != 0; --k) {
+				__m256d live = _mm256_cmp_pd(_mm256_set1_pd(k), count, _CMP_LE_OQ);
+				sum = EF_MULADD256(sum, s2, _mm256_and_pd(_mm256_set1_pd(inverseOdd[k-1]), live));
+			}
+			__m256d z = _mm256_mul_pd(ys, EF_MULADD256(_mm256_mul_pd(twoOverLn2, s), sum, exponent));
+			fine = _mm256_and_pd(fine, _mm256_cmp_pd(_mm256_and_pd(z, magnitude), limit, _CMP_LT_OQ));
+			
+			__m256d whole = _mm256_floor_pd(_mm256_add_pd(z, half));
+			__m256d g = _mm256_mul_pd(_mm256_sub_pd(z, whole), ln2);
+			__m256d longer = _mm256_add_pd(count, four);
+			__m256d r = _mm256_setzero_pd();
+			for(unsigned k = mostTerms+4; k != 0; --k) {
+				__m256d live = _mm256_cmp_pd(_mm256_set1_pd(k), longer, _CMP_LE_OQ);
+				r = EF_MULADD256(r, g, _mm256_and_pd(_mm256_set1_pd(inverseFactorial[k-1]), live));
+			}
+			__m256i scale = _mm256_slli_epi64(_mm256_castpd_si256(_mm256_add_pd(_mm256_add_pd(whole, bias), shift)), 52);
+			_mm256_storeu_pd(out+i, _mm256_mul_pd(r, _mm256_castsi256_pd(scale)));
+			
+			int redo = ~_mm256_movemask_pd(fine) & 0xF;
+			for(unsigned lane = 0; redo; ++lane, redo >>= 1)
+				if(redo & 1) out[i+lane] = std::pow(x[i+lane], y[i+lane]);
+		}
+		return i;
+	}
+	
+	EF_KERNEL("avx512f")
+	size_t avx512Pow(size_t n, const double* x, const double* y, const unsigned* terms, unsigned mostTerms, double* out,
+		const double* inverseOdd, const double* inverseFactorial)
+	{
+		const __m512d one = _mm512_set1_pd(1.0), half = _mm512_set1_pd(0.5), four = _mm512_set1_pd(4.0);
+		const __m512d sqrt2 = _mm512_set1_pd(1.4142135623730951);
+		const __m512d twoOverLn2 = _mm512_set1_pd(2.8853900817779268);
+		const __m512d ln2 = _mm512_set1_pd(0.69314718055994531);
+		const __m512d smallest = _mm512_set1_pd(numeric_limits<double>::min());
+		const __m512d largest = _mm512_set1_pd(numeric_limits<double>::max());
+		const __m512d limit = _mm512_set1_pd(1000.0);
+		const __m512i mantissa = _mm512_set1_epi64(0x000fffffffffffffLL);
+		const __m512i oneBits = _mm512_set1_epi64(0x3ff0000000000000LL);
+		const __m512d shift = _mm512_set1_pd(4503599627370496.0);
+		const __m512i shiftBits = _mm512_castpd_si512(shift);
+		const __m512d bias = _mm512_set1_pd(1023.0);
+		
+		//Zero-masked conversions and shifts: the plain ones set off
+		//-Wmaybe-uninitialized inside GCC 12's own headers.
+		size_t i = 0;
+		for(; i+8 <= n; i += 8) {
+			__m512d xs = _mm512_loadu_pd(x+i);
+			__m512d ys = _mm512_loadu_pd(y+i);
+			__m512d count = _mm512_maskz_cvtepu32_pd(0xFF, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(terms+i)));
+			__mmask8 fine = _mm512_mask_cmp_pd_mask(_mm512_cmp_pd_mask(xs, smallest, _CMP_GE_OQ), xs, largest, _CMP_LE_OQ);
+			
+			__m512i bits = _mm512_castpd_si512(xs);
+			__m512d exponent = _mm512_sub_pd(_mm512_sub_pd(_mm512_castsi512_pd(
+				_mm512_or_si512(_mm512_maskz_srli_epi64(0xFF, bits, 52), shiftBits)), shift), bias);
+			__m512d m = _mm512_castsi512_pd(_mm512_or_si512(_mm512_and_si512(bits, mantissa), oneBits));
+			__mmask8 high = _mm512_cmp_pd_mask(m, sqrt2, _CMP_GT_OQ);
+			m = _mm512_mask_mul_pd(m, high, m, half);
+			exponent = _mm512_mask_add_pd(exponent, high, exponent, one);
+			
+			__m512d s = _mm512_div_pd(_mm512_sub_pd(m, one), _mm512_add_pd(m, one));
+			__m512d s2 = _mm512_mul_pd(s, s);
+			__m512d sum = _mm512_setzero_pd();
+			for(unsigned k = mostTerms; k != 0; --k) {
+				__mmask8 live = _mm512_cmp_pd_mask(_mm512_set1_pd(k), count, _CMP_LE_OQ);
+				sum = EF_MULADD512(sum, s2, _mm512_maskz_mov_pd(live, _mm512_set1_pd(inverseOdd[k-1])));
+			}
+			__m512d z = _mm512_mul_pd(ys, EF_MULADD512(_mm512_mul_pd(twoOverLn2, s), sum, exponent));
+			fine = _mm512_mask_cmp_pd_mask(fine, _mm512_abs_pd(z), limit, _CMP_LT_OQ);
+			
+			__m512d whole = _mm512_floor_pd(_mm512_add_pd(z, half));
+			__m512d g = _mm512_mul_pd(_mm512_sub_pd(z, whole), ln2);
+			__m512d longer = _mm512_add_pd(count, four);
+			__m512d r = _mm512_setzero_pd();
+			for(unsigned k = mostTerms+4; k != 0; --k) {
+				__mmask8 live = _mm512_cmp_pd_mask(_mm512_set1_pd(k), longer, _CMP_LE_OQ);
+				r = EF_MULADD512(r, g, _mm512_maskz_mov_pd(live, _mm512_set1_pd(inverseFactorial[k-1])));
+			}
+			__m512i scale = _mm512_maskz_slli_epi64(0xFF, _mm512_castpd_si512(_mm512_add_pd(_mm512_add_pd(whole, bias), shift)), 52);
+			_mm512_storeu_pd(out+i, _mm512_mul_pd(r, _mm512_castsi512_pd(scale)));
+			
+			for(unsigned redo = static_cast<unsigned>(~fine) & 0xFF, lane = 0; redo; ++lane, redo >>= 1)
+				if(redo & 1) out[i+lane] = std::pow(x[i+lane], y[i+lane]);
+		}
+		return i;
+	}
+	
+	PowKernel selectPowKernel(bool wide)
+	{
+		__builtin_cpu_init();
+		if(wide && __builtin_cpu_supports("avx512f")) return &avx512Pow;
+		if(__builtin_cpu_supports("avx2")) return &avx2Pow;
+		return 0;
+	}
+}
+
+#else
+
+namespace {
+	PowKernel selectPowKernel(bool)
+	{
+		return 0;
+	}
+}
+
+#endif
+
+namespace {
+	const PowKernel powKernel = selectPowKernel(true);
+	//Path segments are short, so an AVX-512 kernel's leftovers are worth
+	//another go four at a time.
+	const PowKernel narrowKernel = selectPowKernel(false);
+}
+
+void FastPow::pow(size_t n, const double* x, const double* y, const unsigned* terms, unsigned mostTerms, double* out)
+{
+	//The kernels leave the tail to us: inlined into them, pow() would lose
+	//its fused multiply-adds and stop matching.
+	size_t i = powKernel ? powKernel(n, x, y, terms, mostTerms, out, inverseOdd, inverseFactorial) : 0;
+	if(narrowKernel && narrowKernel != powKernel && n-i >= 4)
+		i += narrowKernel(n-i, x+i, y+i, terms+i, mostTerms, out+i, inverseOdd, inverseFactorial);
+	for(; i < n; ++i) out[i] = pow(x[i], y[i], terms[i]);
+}
@@ -0,0 +1,98 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+"make check" builds and runs this. For betas from -2.5 to 9.9 and every
+term count, FastPow::pow has to stay within errorBound() of std::pow over
+x from 1e-12 to 1e12, and the batch version has to give the same bits as
+the scalar one. Results that aren't normal numbers (the inputs FastPow
+hands to std::pow) have to come back exactly as std::pow's.
+*/
+
+#include "FastPow.hpp"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+using namespace std;
+
+namespace {
+	bool same(double a, double b)
+	{
+		return memcmp(&a, &b, sizeof a) == 0;
+	}
+}
+
+int main()
+{
+	vector<double> x;
+	for(int k = -1200; k <= 1200; ++k) x.push_back(pow(10.0, k/100.0));
+	//Either side of where the mantissa gets halved.
+	for(int k = -50; k <= 50; ++k) x.push_back(1.4142135623730951 + k*1e-15);
+	x.push_back(1e300);
+	x.push_back(0);
+	x.push_back(numeric_limits<double>::denorm_min());
+	x.push_back(-1);
+	x.push_back(numeric_limits<double>::infinity());
+
+	size_t n = x.size();
+	vector<double> y(n), exact(n), out(n);
+	vector<unsigned> terms(n);
+	unsigned long failures = 0, evaluations = 0;
+	double worst = 0;//Largest error as a fraction of its bound
+
+	for(int step = -250; step <= 990; ++step) {
+		double beta = step/100.0;
+		for(size_t i = 0; i < n; ++i) {
+			y[i] = beta;
+			exact[i] = pow(x[i], beta);
+		}
+		//One term count for the whole batch, then all of them mixed.
+		for(unsigned t = 1; t <= FastPow::maxTerms+1; ++t) {
+			for(size_t i = 0; i < n; ++i) terms[i] = t <= FastPow::maxTerms ? t : static_cast<unsigned>(1 + i%FastPow::maxTerms);
+			FastPow::pow(n, &x[0], &y[0], &terms[0], t <= FastPow::maxTerms ? t : FastPow::maxTerms, &out[0]);
+			for(size_t i = 0; i < n; ++i) {
+				double fast = FastPow::pow(x[i], beta, terms[i]);
+				++evaluations;
+				bool ok = same(fast, out[i]);
+				if(exact[i] >= numeric_limits<double>::min() && exact[i] <= numeric_limits<double>::max()) {
+					double bound = FastPow::errorBound(terms[i], beta);
+					double error = fabs(fast - exact[i])/exact[i];
+					ok = ok && error <= bound;
+					worst = max(worst, error/bound);
+				} else {
+					//Zero, denormal, infinite or NaN: those come from std::pow.
+					ok = ok && (same(fast, exact[i]) || (fast != fast && exact[i] != exact[i]));
+				}
+				if(!ok && ++failures <= 10) {
+					cout.precision(17);
+					cout << "pow(" << x[i] << ", " << beta << ") with " << terms[i] << " terms: "
+						<< fast << " (batch " << out[i] << "), std::pow " << exact[i]
+						<< ", bound " << FastPow::errorBound(terms[i], beta) << endl;
+				}
+			}
+		}
+	}
+	cout << evaluations << " evaluations, " << failures << " failures, worst error "
+		<< worst << " of its bound" << endl;
+	return failures ? 1 : 0;
+}
@@ -19,27 +19,12 @@
 
 
 #include "GraphEdge.hpp"
-#include "BushNode.hpp"
-#include <limits>
 
-using namespace std;
-
-BackwardGraphEdge::BackwardGraphEdge(double d, BushNode *from) : from(from), _distance(d)
-{}
-
-BackwardGraphEdge::BackwardGraphEdge(const BackwardGraphEdge & e) : from(e.from), _distance(e._distance)
+BackwardGraphEdge::BackwardGraphEdge(unsigned from) : from(from)
 {}
 
-ForwardGraphEdge::ForwardGraphEdge(InputGraph::VDF i, BushNode *to, BackwardGraphEdge* inverse):
-	distanceFunction(i),
-	inverse(inverse),
+ForwardGraphEdge::ForwardGraphEdge(unsigned to, unsigned inverse):
 	to(to),
+	inverse(inverse),
 	flow(0)
 {}
-
-ForwardGraphEdge::ForwardGraphEdge(const ForwardGraphEdge& e):
-	distanceFunction(e.distanceFunction),
-	inverse(e.inverse),
-	to(e.to),
-	flow(e.flow)
-{}
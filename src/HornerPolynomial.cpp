@@ -18,52 +18,91 @@
 */
 
 
+
 #include "HornerPolynomial.hpp"
 #include <algorithm>
 #include <functional>
 
-double HornerPolynomial::operator()(double x) const
+HornerPolynomial::HornerPolynomial(const std::vector<double>& coeffs) : terms(0)
+{
+	resize(coeffs.size());
+	std::copy(coeffs.begin(), coeffs.end(), coefficients());
+}
+
+void HornerPolynomial::resize(std::size_t n)
+{
+	if(n > inlineTerms) {
+		if(terms <= inlineTerms) spill.assign(local, local+terms);
+		spill.resize(n, 0.0);
+	} else {
+		if(terms > inlineTerms) std::copy(spill.begin(), spill.begin()+n, local);
+		else std::fill(local+std::min(terms, n), local+n, 0.0);
+		std::vector<double>().swap(spill);
+	}
+	terms = n;
+}
+
+void HornerPolynomial::swap(HornerPolynomial& h)
 {
+	std::swap_ranges(local, local+inlineTerms, h.local);
+	spill.swap(h.spill);
+	std::swap(terms, h.terms);
+}
+
+bool HornerPolynomial::operator<(const HornerPolynomial& h) const
+{
+	if(terms != h.terms) return terms < h.terms;
+	const double* c = coefficients();
+	return std::lexicographical_compare(c, c+terms, h.coefficients(), h.coefficients()+terms);
+}
+
+double HornerPolynomial::derivative(double x) const
+{
+	const double* c = coefficients();
 	double result = 0;
-	for(std::vector<double>::const_reverse_iterator i = coeffs.rbegin(); i != coeffs.rend(); ++i) {
+	for(std::size_t i = terms; i > 1; --i) {
 		result *= x;
-		result += (*i);
+		result += static_cast<double>(i-1)*c[i-1];
 	}
 	return result;
 }
 
 void HornerPolynomial::operator+=(const HornerPolynomial& p)
 {
-	if (p.coeffs.size() > coeffs.size())
-		coeffs.resize(p.coeffs.size());
-	std::transform(coeffs.begin(), coeffs.end(), p.coeffs.begin(), coeffs.begin(), std::plus<double>());
+	if (p.terms > terms)
+		resize(p.terms);
+	double* c = coefficients();
+	std::transform(c, c+p.terms, p.coefficients(), c, std::plus<double>());
 }
 
 void HornerPolynomial::operator-=(const HornerPolynomial& p)
 {
-	if (p.coeffs.size() > coeffs.size())
-		coeffs.resize(p.coeffs.size());
-	std::transform(coeffs.begin(), coeffs.end(), p.coeffs.begin(), coeffs.begin(), std::minus<double>());
+	if (p.terms > terms)
+		resize(p.terms);
+	double* c = coefficients();
+	std::transform(c, c+p.terms, p.coefficients(), c, std::minus<double>());
 }
 
 void HornerPolynomial::multiplyX(double d)
 {
 	double multiple = 1.0;
-	for(std::vector<double>::iterator i = coeffs.begin(); i != coeffs.end(); ++i) {
-		*i *= multiple;
+	double* c = coefficients();
+	for(std::size_t i = 0; i < terms; ++i) {
+		c[i] *= multiple;
 		multiple *= d;
 	}
 }
 
 void HornerPolynomial::operator*=(double d)
 {
-	for(std::vector<double>::iterator i = coeffs.begin(); i != coeffs.end(); ++i)
-		*i *= d;
+	double* c = coefficients();
+	for(std::size_t i = 0; i < terms; ++i)
+		c[i] *= d;
 }
 void HornerPolynomial::operator+=(double d)
 {
-	if(coeffs.size() < 1) coeffs.resize(1);
-	coeffs.at(0) += d;
+	if(terms < 1) resize(1);
+	coefficients()[0] += d;
 }
 
 void HornerPolynomial::shiftXInc(double d)
@@ -74,24 +113,32 @@ void HornerPolynomial::shiftXInc(double d)
 	
 	//Note: This does ax^n --> (ax + d)^n, not a(x+d)^n.
 	if(d == 0) return;
-	std::vector<double> dPowers(coeffs.size(), 1.0);
-	for(std::vector<double>::iterator i = dPowers.begin()+1; i < dPowers.end(); ++i)
-		(*i)=(*(i-1))*d;
+	double* coeffs = coefficients();
+	double localPowers[inlineTerms];
+	std::vector<double> spillPowers;
+	double* dPowers = localPowers;
+	if(terms > inlineTerms) {
+		spillPowers.resize(terms);
+		dPowers = &spillPowers[0];
+	}
+	dPowers[0] = 1.0;
+	for(std::size_t i = 1; i < terms; ++i)
+		dPowers[i] = dPowers[i-1]*d;
 	
-	for(unsigned i = 1; i < coeffs.size(); ++i) {
+	for(unsigned i = 1; i < terms; ++i) {
 		//Dealing with power i
-		double currentCoeff = coeffs.at(i);
+		double currentCoeff = coeffs[i];
 		double rollingCoeff = 1.0;
 		if(currentCoeff==0) continue;//Most of our polynomials likely have few terms in x.
 		unsigned pascalsCoeff = 1;
 		for(unsigned j = 0; j < i; ++j) {
 			//modifying coefficient in place j
-			coeffs.at(j) += rollingCoeff * pascalsCoeff * dPowers.at(i-j);
+			coeffs[j] += rollingCoeff * pascalsCoeff * dPowers[i-j];
 			pascalsCoeff = (pascalsCoeff*(i-j))/(j+1);
 			rollingCoeff *= currentCoeff;
 			//See http://en.wikipedia.org/wiki/Pascal's_Triangle#Calculating_an_individual_row
 		}
-		coeffs.at(i) = rollingCoeff;
+		coeffs[i] = rollingCoeff;
 	}
 }
 void HornerPolynomial::shiftX(double d)
@@ -102,18 +149,26 @@ void HornerPolynomial::shiftX(double d)
 	
 	//Note: This does ax^n --> a(x+d)^n.
 	if(d == 0) return;
-	std::vector<double> dPowers(coeffs.size(), 1.0);
-	for(std::vector<double>::iterator i = dPowers.begin()+1; i < dPowers.end(); ++i)
-		(*i)=(*(i-1))*d;
+	double* coeffs = coefficients();
+	double localPowers[inlineTerms];
+	std::vector<double> spillPowers;
+	double* dPowers = localPowers;
+	if(terms > inlineTerms) {
+		spillPowers.resize(terms);
+		dPowers = &spillPowers[0];
+	}
+	dPowers[0] = 1.0;
+	for(std::size_t i = 1; i < terms; ++i)
+		dPowers[i] = dPowers[i-1]*d;
 	
-	for(unsigned i = 1; i < coeffs.size(); ++i) {
+	for(unsigned i = 1; i < terms; ++i) {
 		//Dealing with power i
-		double currentCoeff = coeffs.at(i);
+		double currentCoeff = coeffs[i];
 		if(currentCoeff==0) continue;//Most of our polynomials likely have few terms in x.
 		unsigned pascalsCoeff = 1;
 		for(unsigned j = 0; j < i; ++j) {
 			//modifying coefficient in place j
-			coeffs.at(j) += currentCoeff * pascalsCoeff * dPowers.at(i-j);
+			coeffs[j] += currentCoeff * pascalsCoeff * dPowers[i-j];
 			pascalsCoeff = (pascalsCoeff*(i-j))/(j+1);
 			//See http://en.wikipedia.org/wiki/Pascal's_Triangle#Calculating_an_individual_row
 		}
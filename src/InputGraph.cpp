@@ -0,0 +1,90 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "InputGraph.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace {
+	bool demandOrder(const InputGraph::Demand& a, const InputGraph::Demand& b) {
+		if(a.from != b.from) return a.from < b.from;
+		return a.to < b.to;
+	}
+}
+
+void InputGraph::finalise()
+{
+	if(finalised) return;
+	finalised = true;
+
+	if(!pendingEdges.empty()) {
+		//Anything finalised earlier goes in first, so newer links replace it.
+		if(!_graph.empty()) {
+			vector<EdgeKey> keys;
+			vector<VDF> functions(_graph.size());
+			keys.reserve(_graph.size() + pendingEdges.size());
+			for(unsigned i = 0; i < _graph.size(); ++i) {
+				keys.push_back(EdgeKey(_graph[i].from, _graph[i].to, i));
+				functions[i].swap(_graph[i].vdf);
+			}
+			unsigned offset = static_cast<unsigned>(_graph.size());
+			for(vector<EdgeKey>::iterator i = pendingEdges.begin(); i != pendingEdges.end(); ++i)
+				keys.push_back(EdgeKey(i->from, i->to, i->sequence + offset));
+			functions.resize(_graph.size() + pendingFunctions.size());
+			for(unsigned i = 0; i < pendingFunctions.size(); ++i)
+				functions[i+offset].swap(pendingFunctions[i]);
+			keys.swap(pendingEdges);
+			functions.swap(pendingFunctions);
+			_graph.clear();
+		}
+
+		//Importers mostly hand us sorted links already, skip the sort then.
+		bool sorted = true;
+		for(unsigned i = 1; i < pendingEdges.size() && sorted; ++i)
+			sorted = pendingEdges[i-1] < pendingEdges[i];
+		if(!sorted) sort(pendingEdges.begin(), pendingEdges.end());
+
+		_graph.reserve(pendingEdges.size());
+		for(vector<EdgeKey>::iterator i = pendingEdges.begin(); i != pendingEdges.end(); ++i) {
+			if(i+1 != pendingEdges.end() && i->from == (i+1)->from && i->to == (i+1)->to) continue;//Last one wins
+			_graph.push_back(Edge(i->from, i->to));
+			_graph.back().vdf.swap(pendingFunctions[i->sequence]);
+		}
+		vector<EdgeKey>().swap(pendingEdges);
+		vector<VDF>().swap(pendingFunctions);
+	}
+
+	//Stable, so duplicate OD pairs get summed in the order they were added.
+	//Trip tables are usually in order already, so check first.
+	bool sorted = true;
+	for(unsigned i = 1; i < _demand.size() && sorted; ++i)
+		sorted = !demandOrder(_demand[i], _demand[i-1]);
+	if(!sorted) stable_sort(_demand.begin(), _demand.end(), demandOrder);
+	vector<Demand>::iterator out = _demand.begin();
+	for(vector<Demand>::iterator i = _demand.begin(); i != _demand.end(); ++i) {
+		if(out != _demand.begin() && (out-1)->from == i->from && (out-1)->to == i->to)
+			(out-1)->amount += i->amount;
+		else
+			*out++ = *i;
+	}
+	_demand.erase(out, _demand.end());
+}
@@ -0,0 +1,77 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "MappedFile.hpp"
+
+#ifdef _MSC_VER
+ #include <fstream>
+ #include <iterator>
+#else
+ #include <sys/mman.h>
+ #include <sys/stat.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+#endif
+
+using namespace std;
+
+#ifdef _MSC_VER
+
+MappedFile::MappedFile(const char* path) : data(0), length(0)
+{
+	ifstream in(path, ios::in | ios::binary);
+	if(!in) throw "File does not exist";
+	fallback.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+	length = fallback.size();
+	if(length) data = &fallback[0];
+}
+
+MappedFile::~MappedFile()
+{}
+
+#else
+
+MappedFile::MappedFile(const char* path) : data(0), length(0)
+{
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) throw "File does not exist";
+	struct stat st;
+	if(fstat(fd, &st) != 0) {
+		close(fd);
+		throw "Could not stat file";
+	}
+	length = static_cast<size_t>(st.st_size);
+	if(length == 0) {
+		close(fd);
+		return;//mmap refuses zero-length maps. Nothing to parse anyway.
+	}
+	void* mapping = mmap(0, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);//The mapping keeps its own reference to the file.
+	if(mapping == MAP_FAILED) throw "Could not map file";
+	madvise(mapping, length, MADV_SEQUENTIAL);//We read it front to back, once.
+	data = static_cast<const char*>(mapping);
+}
+
+MappedFile::~MappedFile()
+{
+	if(length) munmap(const_cast<char*>(data), length);
+}
+
+#endif
@@ -0,0 +1,246 @@
+/*
+    Copyright 2008, 2009 Matthew Steel.
+
+    This file is part of EF.
+
+    EF is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as
+    published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    EF is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public
+    License along with EF.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "NetworkCache.hpp"
+#include "MappedFile.hpp"
+#include "CostFunction.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <cstdio>//rename, remove
+#include <cstring>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace {
+	//Size and mtime (in nanoseconds, so an edit in the same second as the
+	//last save still counts) of a file, both zero if it doesn't exist.
+	void fileStamp(const string& path, uint64_t& size, uint64_t& time)
+	{
+		struct stat st;
+		if(stat(path.c_str(), &st) != 0) {
+			size = time = 0;
+			return;
+		}
+		size = static_cast<uint64_t>(st.st_size);
+#ifdef _MSC_VER
+		time = static_cast<uint64_t>(st.st_mtime)*1000000000u;//Seconds are all we get.
+#else
+		time = static_cast<uint64_t>(st.st_mtim.tv_sec)*1000000000u + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+#endif
+	}
+
+	std::size_t padding(std::size_t bytes) { return (8 - bytes%8)%8; }
+
+	template<typename T>
+	void writeArray(ofstream& o, const vector<T>& v)
+	{
+		static const char zeros[8] = {0};
+		if(!v.empty()) o.write(reinterpret_cast<const char*>(&v[0]), static_cast<streamsize>(v.size()*sizeof(T)));
+		o.write(zeros, static_cast<streamsize>(padding(v.size()*sizeof(T))));
+	}
+
+	//Walks the mapped file handing out arrays. Gives back 0 for any that
+	//run off the end of the file.
+	class ArrayReader {
+		public:
+			ArrayReader(const char* begin, const char* end) : pos(begin), end(end) {}
+			template<typename T>
+			const T* next(std::size_t count) {
+				std::size_t bytes = count*sizeof(T);
+				if(static_cast<std::size_t>(end-pos) < bytes) return 0;
+				const T* ret = reinterpret_cast<const T*>(pos);
+				pos += bytes + padding(bytes);
+				if(pos > end) pos = end;
+				return ret;
+			}
+		private:
+			const char* pos;
+			const char* end;
+	};
+
+	//A CSR offset array has to start at 0, never go backwards and end at
+	//the number of entries.
+	bool validOffsets(const uint32_t* offsets, uint32_t rows, uint32_t entries)
+	{
+		if(offsets[0] != 0 || offsets[rows] != entries) return false;
+		for(uint32_t i = 0; i < rows; ++i)
+			if(offsets[i] > offsets[i+1]) return false;
+		return true;
+	}
+
+	bool validNodes(const uint32_t* ids, uint32_t count, uint32_t nodes)
+	{
+		for(uint32_t i = 0; i < count; ++i)
+			if(ids[i] >= nodes) return false;
+		return true;
+	}
+
+	bool linkOrder(const NetworkCache::Link& a, const NetworkCache::Link& b) {
+		if(a.from != b.from) return a.from < b.from;
+		return a.to < b.to;
+	}
+}
+
+NetworkCache::NetworkCache(const char* cacheFile, const char* networkFile, const char* tripsFile, double distanceCost, double tollCost) :
+	cacheFile(cacheFile), networkFile(networkFile), tripsFile(tripsFile),
+	distanceCost(distanceCost), tollCost(tollCost), cacheSize(0)
+{}
+
+void NetworkCache::fillHeader(Header& h) const
+{
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "EFCACHE", 8);
+	h.version = version;
+	h.byteOrder = 0x01020304;
+	fileStamp(networkFile, h.networkSize, h.networkTime);
+	fileStamp(tripsFile, h.tripsSize, h.tripsTime);
+	h.distanceCost = distanceCost;
+	h.tollCost = tollCost;
+}
+
+bool NetworkCache::load(InputGraph& graph, double powError)
+{
+	struct stat st;
+	if(stat(cacheFile.c_str(), &st) != 0) return false;
+
+	try {
+		MappedFile file(cacheFile.c_str());
+		return load(file, graph, powError);
+	} catch(const char*) {
+		return false;//Couldn't map it. Reparse.
+	}
+}
+
+bool NetworkCache::load(const MappedFile& file, InputGraph& graph, double powError)
+{
+	if(file.size() < sizeof(Header)) return false;
+	Header expected, h;
+	fillHeader(expected);
+	memcpy(&h, file.begin(), sizeof(Header));
+	if(memcmp(h.magic, expected.magic, 8) != 0 || h.version != expected.version ||
+	   h.byteOrder != expected.byteOrder ||
+	   h.networkSize != expected.networkSize || h.networkTime != expected.networkTime ||
+	   h.tripsSize != expected.tripsSize || h.tripsTime != expected.tripsTime ||
+	   h.distanceCost != expected.distanceCost || h.tollCost != expected.tollCost)
+		return false;
+
+	ArrayReader r(file.begin()+sizeof(Header), file.end());
+	const uint32_t* linkOffsets = r.next<uint32_t>(static_cast<size_t>(h.nodes)+1);
+	const uint32_t* linkTo = r.next<uint32_t>(h.links);
+	const double* zeroFlowTime = r.next<double>(h.links);
+	const double* capacity = r.next<double>(h.links);
+	const double* alpha = r.next<double>(h.links);
+	const double* beta = r.next<double>(h.links);
+	const double* extraCost = r.next<double>(h.links);
+	const uint32_t* origins = r.next<uint32_t>(h.origins);
+	const uint32_t* demandOffsets = r.next<uint32_t>(static_cast<size_t>(h.origins)+1);
+	const uint32_t* destinations = r.next<uint32_t>(h.odPairs);
+	const double* demand = r.next<double>(h.odPairs);
+	//Anything cut short or out of range and we'd rather reparse than crash.
+	if(!linkOffsets || !linkTo || !zeroFlowTime || !capacity || !alpha || !beta || !extraCost ||
+	   !origins || !demandOffsets || !destinations || !demand)
+		return false;
+	if(!validOffsets(linkOffsets, h.nodes, h.links) || !validNodes(linkTo, h.links, h.nodes) ||
+	   !validOffsets(demandOffsets, h.origins, h.odPairs) || !validNodes(origins, h.origins, h.nodes) ||
+	   !validNodes(destinations, h.odPairs, h.nodes))
+		return false;
+
+	graph.setNodes(h.nodes);
+	graph.reserve(h.links, h.odPairs);//Already sorted, so finalising is one pass.
+	for(uint32_t from = 0; from < h.nodes; ++from) {
+		for(uint32_t i = linkOffsets[from]; i != linkOffsets[from+1]; ++i) {
+			graph.addEdge(from, linkTo[i], CostFunction(zeroFlowTime[i], capacity[i], alpha[i], beta[i], extraCost[i], powError));
+		}
+	}
+	for(uint32_t o = 0; o < h.origins; ++o) {
+		for(uint32_t i = demandOffsets[o]; i != demandOffsets[o+1]; ++i)
+			graph.addDemand(origins[o], destinations[i], demand[i]);
+	}
+	graph.finalise();
+	cacheSize = file.size();
+	return true;
+}
+
+void NetworkCache::save(const InputGraph& graph, vector<Link>& links)
+{
+	Header h;
+	fillHeader(h);
+	h.nodes = graph.numNodes();
+
+	//Same semantics as InputGraph: the last definition of a link wins.
+	stable_sort(links.begin(), links.end(), linkOrder);
+	vector<uint32_t> linkOffsets(h.nodes+1, 0), linkTo;
+	vector<double> zeroFlowTime, capacity, alpha, beta, extraCost;
+	for(vector<Link>::iterator i = links.begin(); i != links.end(); ++i) {
+		if(i+1 != links.end() && i->from == (i+1)->from && i->to == (i+1)->to) continue;
+		++linkOffsets.at(i->from+1);
+		linkTo.push_back(i->to);
+		zeroFlowTime.push_back(i->zeroFlowTime);
+		capacity.push_back(i->capacity);
+		alpha.push_back(i->alpha);
+		beta.push_back(i->beta);
+		extraCost.push_back(i->extraCost);
+	}
+	for(uint32_t i = 0; i < h.nodes; ++i) linkOffsets[i+1] += linkOffsets[i];
+	h.links = static_cast<uint32_t>(linkTo.size());
+
+	vector<uint32_t> origins, demandOffsets(1, 0), destinations;
+	vector<double> demand;
+	const vector<InputGraph::Demand>& od = graph.demand();
+	for(vector<InputGraph::Demand>::const_iterator i = od.begin(); i != od.end(); ++i) {
+		if(origins.empty() || origins.back() != i->from) {
+			if(!origins.empty()) demandOffsets.push_back(static_cast<uint32_t>(destinations.size()));
+			origins.push_back(i->from);
+		}
+		destinations.push_back(i->to);
+		demand.push_back(i->amount);
+	}
+	if(!origins.empty()) demandOffsets.push_back(static_cast<uint32_t>(destinations.size()));
+	h.origins = static_cast<uint32_t>(origins.size());
+	h.odPairs = static_cast<uint32_t>(destinations.size());
+
+	//Write somewhere else and rename, so a crash never leaves half a cache.
+	string temp = cacheFile + ".tmp";
+	{
+		ofstream o(temp.c_str(), ios::out | ios::binary | ios::trunc);
+		if(!o) return;//Not being able to cache isn't fatal.
+		o.write(reinterpret_cast<const char*>(&h), sizeof(h));
+		writeArray(o, linkOffsets);
+		writeArray(o, linkTo);
+		writeArray(o, zeroFlowTime);
+		writeArray(o, capacity);
+		writeArray(o, alpha);
+		writeArray(o, beta);
+		writeArray(o, extraCost);
+		writeArray(o, origins);
+		writeArray(o, demandOffsets);
+		writeArray(o, destinations);
+		writeArray(o, demand);
+		if(!o) {
+			o.close();
+			remove(temp.c_str());
+			return;
+		}
+	}
+	remove(cacheFile.c_str());//rename won't replace on some platforms
+	rename(temp.c_str(), cacheFile.c_str());
+}
@@ -27,3 +27,10 @@ void Origin::addDestination(int i, double d)
 {
 	destinations.push_back(std::pair<int,double>(i, d));
 }
+
+void Origin::renumber(const std::vector<unsigned>& ids)
+{
+	origin = ids[origin];
+	for(std::vector<std::pair<int,double> >::iterator i = destinations.begin(); i != destinations.end(); ++i)
+		i->first = ids[i->first];
+}